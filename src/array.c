@@ -1,40 +1,77 @@
 #include "array.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define ARRAY_RAW_DATA(array) ((int*)(array)-2)
-#define ARRAY_CAPACITY(array) (ARRAY_RAW_DATA(array)[0])
-#define ARRAY_OCCUPIED(array) (ARRAY_RAW_DATA(array)[1])
+#define ARRAY_MIN_CAPACITY 16
+
+/**
+ * Reallocate the array with room for `capacity` items. Running out of
+ * memory is fatal, since none of the callers could carry on without the
+ * data.
+ */
+static void* array_resize(void* array, size_t capacity, size_t item_size) {
+    if (capacity > (SIZE_MAX - sizeof(array_header_t)) / item_size) {
+        fprintf(stderr, "Array of %zu items is too large.\n", capacity);
+        abort();
+    }
+
+    size_t raw_size = sizeof(array_header_t) + (item_size * capacity);
+    array_header_t* header =
+        (array_header_t*)realloc(array ? ARRAY_HEADER(array) : NULL, raw_size);
+    if (header == NULL) {
+        fprintf(stderr, "Error allocating %zu bytes for an array.\n",
+                raw_size);
+        abort();
+    }
 
-void* array_hold(void* array, int count, int item_size) {
     if (array == NULL) {
-        int raw_size = (sizeof(int) * 2) + (item_size * count);
-        int* base = (int*)malloc(raw_size);
-        base[0] = count;  // capacity
-        base[1] = count;  // occupied
-        return base + 2;
-    } else if (ARRAY_OCCUPIED(array) + count <= ARRAY_CAPACITY(array)) {
-        ARRAY_OCCUPIED(array) += count;
+        header->length = 0;
+    }
+    header->capacity = capacity;
+    return header + 1;
+}
+
+/**
+ * Make sure there is room for `count` more items. The capacity at least
+ * doubles, so pushing n items costs O(n) copies in total.
+ */
+void* array_grow(void* array, size_t count, size_t item_size) {
+    size_t length = array_length(array);
+    size_t capacity = array_capacity(array);
+
+    if (count > SIZE_MAX - length) {
+        fprintf(stderr, "Array length overflow.\n");
+        abort();
+    }
+    size_t needed = length + count;
+    if (needed <= capacity && array != NULL) {
         return array;
-    } else {
-        int needed_size = ARRAY_OCCUPIED(array) + count;
-        int float_curr = ARRAY_CAPACITY(array) * 2;
-        int capacity = needed_size > float_curr ? needed_size : float_curr;
-        int occupied = needed_size;
-        int raw_size = sizeof(int) * 2 + item_size * capacity;
-        int* base = (int*)realloc(ARRAY_RAW_DATA(array), raw_size);
-        base[0] = capacity;
-        base[1] = occupied;
-        return base + 2;
     }
+
+    size_t new_capacity = capacity < SIZE_MAX / 2 ? capacity * 2 : needed;
+    if (new_capacity < needed) new_capacity = needed;
+    if (new_capacity < ARRAY_MIN_CAPACITY) new_capacity = ARRAY_MIN_CAPACITY;
+
+    return array_resize(array, new_capacity, item_size);
 }
 
-int array_length(void* array) {
-    return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
+/**
+ * Give back the capacity past the current length.
+ */
+void* array_shrink_to_fit(void* array, size_t item_size) {
+    if (array == NULL || array_length(array) == array_capacity(array)) {
+        return array;
+    }
+    if (array_length(array) == 0) {
+        array_free(array);
+        return NULL;
+    }
+    return array_resize(array, array_length(array), item_size);
 }
 
 void array_free(void* array) {
     if (array != NULL) {
-        free(ARRAY_RAW_DATA(array));
+        free(ARRAY_HEADER(array));
     }
 }
@@ -1,14 +1,81 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
-#define array_push(array, value)                            \
-    do {                                                    \
-        (array) = array_hold((array), 1, sizeof(*(array))); \
-        (array)[array_length(array) - 1] = (value);         \
-    } while (0);
-
-void* array_hold(void* array, int count, int item_size);
-int array_length(void* array);
+#include <stddef.h>
+#include <string.h>
+
+// Dynamic arrays are plain typed pointers (like `vec3_t* vertices`) with a
+// header stored just before the first element. A NULL pointer is an empty
+// array.
+typedef struct {
+    size_t capacity;
+    size_t length;
+} array_header_t;
+
+#define ARRAY_HEADER(array) ((array_header_t*)(array) - 1)
+
+// Append one value. Only grows (and calls out) when the array is full.
+#define array_push(array, value)                                  \
+    do {                                                          \
+        if (array_length(array) == array_capacity(array)) {       \
+            (array) = array_grow((array), 1, sizeof(*(array)));   \
+        }                                                         \
+        (array)[ARRAY_HEADER(array)->length++] = (value);         \
+    } while (0)
+
+// Append `count` values copied from `values`.
+#define array_append_n(array, values, count)                           \
+    do {                                                               \
+        size_t append_count_ = (count);                                \
+        if (append_count_ > 0) {                                       \
+            (array) = array_grow((array), append_count_,               \
+                                 sizeof(*(array)));                    \
+            memcpy((array) + array_length(array), (values),            \
+                   append_count_ * sizeof(*(array)));                  \
+            ARRAY_HEADER(array)->length += append_count_;              \
+        }                                                              \
+    } while (0)
+
+// Append `count` uninitialized values, to be filled in place (for example
+// by several threads, each writing its own part).
+#define array_extend(array, count)                                     \
+    do {                                                               \
+        size_t extend_count_ = (count);                                \
+        if (extend_count_ > 0) {                                       \
+            (array) = array_grow((array), extend_count_,               \
+                                 sizeof(*(array)));                    \
+            ARRAY_HEADER(array)->length += extend_count_;              \
+        }                                                              \
+    } while (0)
+
+// Make room for `count` more values without changing the length.
+#define array_reserve(array, count) \
+    ((array) = array_grow((array), (count), sizeof(*(array))))
+
+// Release the unused capacity.
+#define array_shrink(array) \
+    ((array) = array_shrink_to_fit((array), sizeof(*(array))))
+
+void* array_grow(void* array, size_t count, size_t item_size);
+void* array_shrink_to_fit(void* array, size_t item_size);
 void array_free(void* array);
 
+static inline size_t array_length(const void* array) {
+    return (array != NULL) ? ARRAY_HEADER(array)->length : 0;
+}
+
+static inline size_t array_capacity(const void* array) {
+    return (array != NULL) ? ARRAY_HEADER(array)->capacity : 0;
+}
+
+/**
+ * Set the length to zero but keep the memory, so refilling the array every
+ * frame doesn't allocate.
+ */
+static inline void array_clear(void* array) {
+    if (array != NULL) {
+        ARRAY_HEADER(array)->length = 0;
+    }
+}
+
 #endif
@@ -0,0 +1,360 @@
+#include "capture.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+
+// Frames travel from the render loop to the writer thread through a ring of
+// CAPTURE_QUEUE_SIZE buffers that are allocated once and reused. The render
+// loop copies into the slot after the last queued frame, and the writer
+// frees the oldest slot once it's on disk. When every slot is in use the
+// frame is dropped, so the render loop never waits on disk I/O, unless the
+// capture is lossless: then the render loop waits for the writer instead.
+static struct {
+    bool is_running;
+    bool is_stopping;
+    bool is_lossless;
+    bool has_failed;
+    enum capture_format format;
+    char path[1024];
+    // A PPM sequence's file names: prefix, zero padded frame number, suffix
+    char prefix[1024];
+    char suffix[1024];
+    int number_width;
+    int width;
+    int height;
+    int fps;
+
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* frame_ready;
+    SDL_cond* slot_free;
+
+    uint32_t* buffers[CAPTURE_QUEUE_SIZE];
+    int read_index;  // oldest queued frame
+    int count;       // number of queued frames
+
+    int frames_written;
+    int frames_dropped;
+    Uint64 start_time;
+} capture;
+
+/**
+ * Pick the output format from the path: *.y4m is a video stream, *.raw is
+ * a raw stream and anything else is a PPM sequence.
+ */
+static enum capture_format format_from_path(const char* path) {
+    const char* extension = strrchr(path, '.');
+    if (extension != NULL && strcmp(extension, ".y4m") == 0) {
+        return CAPTURE_Y4M;
+    }
+    if (extension != NULL && strcmp(extension, ".raw") == 0) {
+        return CAPTURE_RAW;
+    }
+    return CAPTURE_PPM_SEQUENCE;
+}
+
+/**
+ * Copy text up to the end or the first lone '%' into out, turning "%%" into
+ * '%'. Returns where it stopped, or NULL if the text doesn't fit in
+ * out_size bytes.
+ */
+static const char* copy_literal(const char* text, char* out,
+                                size_t out_size) {
+    size_t length = 0;
+    while (*text != '\0') {
+        if (text[0] == '%' && text[1] == '%') {
+            text++;
+        } else if (text[0] == '%') {
+            break;
+        }
+        if (length + 1 >= out_size) {
+            return NULL;
+        }
+        out[length++] = *text++;
+    }
+    out[length] = '\0';
+    return text;
+}
+
+/**
+ * Split a PPM sequence path like "frames/frame_%05d.ppm" around its one
+ * frame number conversion, %d with an optional zero flag and width. The
+ * path is never used as a format string itself. Returns false if the path
+ * has no conversion, more than one, or any other kind.
+ */
+static bool parse_sequence_path(const char* path) {
+    const char* rest =
+        copy_literal(path, capture.prefix, sizeof(capture.prefix));
+    if (rest == NULL) {
+        printf("capture path is too long: %s\n", path);
+        return false;
+    }
+    if (*rest != '%') {
+        printf("capture path needs a frame number like %%05d: %s\n", path);
+        return false;
+    }
+
+    rest++;
+    while (*rest == '0') {
+        rest++;
+    }
+    capture.number_width = 0;
+    while (*rest >= '0' && *rest <= '9' && capture.number_width < 100) {
+        capture.number_width = capture.number_width * 10 + (*rest++ - '0');
+    }
+    if (*rest != 'd') {
+        printf("capture path may only use %%d for the frame number: %s\n",
+               path);
+        return false;
+    }
+
+    rest = copy_literal(rest + 1, capture.suffix, sizeof(capture.suffix));
+    if (rest == NULL) {
+        printf("capture path is too long: %s\n", path);
+        return false;
+    }
+    if (*rest != '\0') {
+        printf("capture path has more than one conversion: %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool write_ppm(const uint32_t* buffer, int frame_number) {
+    char filename[2200];
+    snprintf(filename, sizeof(filename), "%s%0*d%s", capture.prefix,
+             capture.number_width, frame_number, capture.suffix);
+    return save_ppm_image(filename, buffer, capture.width, capture.height);
+}
+
+static uint8_t clamp_byte(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/**
+ * Convert an ARGB color to full range BT.601 Y, Cb and Cr.
+ */
+void capture_rgb_to_ycbcr(uint32_t color, uint8_t ycbcr[3]) {
+    int r = (color >> 16) & 0xFF;
+    int g = (color >> 8) & 0xFF;
+    int b = color & 0xFF;
+    // Coefficients are scaled by 2^16. Rounding takes pure red's Cr and
+    // pure blue's Cb to 256, so the chroma is clamped.
+    ycbcr[0] = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+    ycbcr[1] =
+        clamp_byte((-11059 * r - 21709 * g + 32768 * b + 8421376) >> 16);
+    ycbcr[2] =
+        clamp_byte((32768 * r - 27439 * g - 5329 * b + 8421376) >> 16);
+}
+
+/**
+ * Convert a frame to Y, Cb and Cr planes and write it to the stream.
+ */
+static bool write_y4m_frame(FILE* file, const uint32_t* buffer,
+                            uint8_t* scratch) {
+    int num_pixels = capture.width * capture.height;
+    uint8_t* y_plane = scratch;
+    uint8_t* u_plane = scratch + num_pixels;
+    uint8_t* v_plane = scratch + num_pixels * 2;
+
+    for (int i = 0; i < num_pixels; i++) {
+        uint8_t ycbcr[3];
+        capture_rgb_to_ycbcr(buffer[i], ycbcr);
+        y_plane[i] = ycbcr[0];
+        u_plane[i] = ycbcr[1];
+        v_plane[i] = ycbcr[2];
+    }
+
+    fputs("FRAME\n", file);
+    return fwrite(scratch, 1, num_pixels * 3, file) == (size_t)num_pixels * 3;
+}
+
+static int writer_thread(void* data) {
+    (void)data;
+    FILE* stream = NULL;
+    size_t frame_size = sizeof(uint32_t) * capture.width * capture.height;
+    uint8_t* scratch = NULL;  // Y, Cb and Cr planes of a Y4M frame
+    if (capture.format == CAPTURE_Y4M) {
+        scratch = (uint8_t*)malloc(frame_size);
+    }
+
+    if (capture.format != CAPTURE_PPM_SEQUENCE) {
+        stream = fopen(capture.path, "wb");
+        if (stream == NULL) {
+            printf("cannot open capture file: %s\n", capture.path);
+            capture.has_failed = true;
+        } else if (capture.format == CAPTURE_Y4M) {
+            fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 "
+                            "XCOLORRANGE=FULL\n",
+                    capture.width, capture.height, capture.fps);
+        }
+    }
+
+    while (true) {
+        SDL_LockMutex(capture.lock);
+        while (capture.count == 0 && !capture.is_stopping) {
+            SDL_CondWait(capture.frame_ready, capture.lock);
+        }
+        if (capture.count == 0) {
+            SDL_UnlockMutex(capture.lock);
+            break;  // stopping and the queue is drained
+        }
+        uint32_t* buffer = capture.buffers[capture.read_index];
+        SDL_UnlockMutex(capture.lock);
+
+        // The slot belongs to the writer until count goes down
+        if (!capture.has_failed) {
+            bool is_ok;
+            if (capture.format == CAPTURE_PPM_SEQUENCE) {
+                is_ok = write_ppm(buffer, capture.frames_written);
+            } else if (capture.format == CAPTURE_Y4M) {
+                is_ok = write_y4m_frame(stream, buffer, scratch);
+            } else {
+                is_ok = fwrite(buffer, 1, frame_size, stream) == frame_size;
+            }
+            if (is_ok) {
+                capture.frames_written++;
+            } else {
+                printf("capture write failed, discarding further frames\n");
+                capture.has_failed = true;
+            }
+        }
+
+        SDL_LockMutex(capture.lock);
+        capture.read_index = (capture.read_index + 1) % CAPTURE_QUEUE_SIZE;
+        capture.count--;
+        SDL_CondSignal(capture.slot_free);
+        SDL_UnlockMutex(capture.lock);
+    }
+
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    free(scratch);
+    return 0;
+}
+
+/**
+ * Start writing every captured frame to `path` on a background thread.
+ *
+ * PPM sequences need exactly one %d pattern for the frame number in the
+ * path, like "frames/frame_%05d.ppm". Returns false for any other path.
+ *
+ * Frames that arrive while the writer is CAPTURE_QUEUE_SIZE frames behind
+ * are dropped, or waited for when is_lossless.
+ */
+bool capture_start(const char* path, int width, int height, int fps,
+                   bool is_lossless) {
+    if (capture.is_running) {
+        return false;
+    }
+
+    if (strlen(path) >= sizeof(capture.path)) {
+        printf("capture path is too long: %s\n", path);
+        return false;
+    }
+
+    memset(&capture, 0, sizeof(capture));
+    capture.format = format_from_path(path);
+    snprintf(capture.path, sizeof(capture.path), "%s", path);
+    capture.width = width;
+    capture.height = height;
+    capture.fps = fps;
+    capture.is_lossless = is_lossless;
+    if (capture.format == CAPTURE_PPM_SEQUENCE &&
+        !parse_sequence_path(capture.path)) {
+        return false;
+    }
+
+    for (int i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+        capture.buffers[i] =
+            (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+    }
+
+    capture.lock = SDL_CreateMutex();
+    capture.frame_ready = SDL_CreateCond();
+    capture.slot_free = SDL_CreateCond();
+    capture.start_time = SDL_GetPerformanceCounter();
+    capture.thread = SDL_CreateThread(writer_thread, "capture", NULL);
+    if (capture.thread == NULL) {
+        fprintf(stderr, "Error creating capture thread: %s\n", SDL_GetError());
+        capture.is_running = true;  // so capture_stop() cleans up
+        capture_stop();
+        return false;
+    }
+
+    capture.is_running = true;
+    return true;
+}
+
+bool capture_is_running(void) { return capture.is_running; }
+
+/**
+ * Queue a copy of a finished frame for the writer thread. If the writer is
+ * CAPTURE_QUEUE_SIZE frames behind, the frame is dropped, or a lossless
+ * capture waits for the writer.
+ */
+void capture_frame(const uint32_t* buffer) {
+    if (!capture.is_running) {
+        return;
+    }
+
+    SDL_LockMutex(capture.lock);
+    while (capture.count == CAPTURE_QUEUE_SIZE && capture.is_lossless) {
+        SDL_CondWait(capture.slot_free, capture.lock);
+    }
+    if (capture.count == CAPTURE_QUEUE_SIZE) {
+        SDL_UnlockMutex(capture.lock);
+        capture.frames_dropped++;
+        return;
+    }
+    int write_index =
+        (capture.read_index + capture.count) % CAPTURE_QUEUE_SIZE;
+    SDL_UnlockMutex(capture.lock);
+
+    // The writer never touches slots past the queued ones, so copy unlocked
+    memcpy(capture.buffers[write_index], buffer,
+           sizeof(uint32_t) * capture.width * capture.height);
+
+    SDL_LockMutex(capture.lock);
+    capture.count++;
+    SDL_CondSignal(capture.frame_ready);
+    SDL_UnlockMutex(capture.lock);
+}
+
+/**
+ * Flush the queued frames, stop the writer and report the throughput.
+ * Returns false if any frame could not be written.
+ */
+bool capture_stop(void) {
+    if (!capture.is_running) {
+        return true;
+    }
+
+    if (capture.thread != NULL) {
+        SDL_LockMutex(capture.lock);
+        capture.is_stopping = true;
+        SDL_CondSignal(capture.frame_ready);
+        SDL_UnlockMutex(capture.lock);
+        SDL_WaitThread(capture.thread, NULL);
+
+        double seconds =
+            (double)(SDL_GetPerformanceCounter() - capture.start_time) /
+            SDL_GetPerformanceFrequency();
+        printf("captured %d frames (%d dropped) in %.2f s: %.1f frames/sec "
+               "written\n",
+               capture.frames_written, capture.frames_dropped, seconds,
+               seconds > 0 ? capture.frames_written / seconds : 0.0);
+    }
+
+    for (int i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+        free(capture.buffers[i]);
+    }
+    SDL_DestroyCond(capture.slot_free);
+    SDL_DestroyCond(capture.frame_ready);
+    SDL_DestroyMutex(capture.lock);
+    capture.is_running = false;
+    return capture.thread != NULL && !capture.has_failed;
+}
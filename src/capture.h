@@ -0,0 +1,24 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// How many frames can wait for the writer before new frames are dropped, or
+// the render loop waits in a lossless capture
+#define CAPTURE_QUEUE_SIZE 8
+
+enum capture_format {
+    CAPTURE_PPM_SEQUENCE,  // one PPM file per frame, path has one %d pattern
+    CAPTURE_Y4M,           // a single YUV4MPEG2 (4:4:4) video stream
+    CAPTURE_RAW            // a single stream of raw ARGB8888 frames
+};
+
+bool capture_start(const char* path, int width, int height, int fps,
+                   bool is_lossless);
+bool capture_is_running(void);
+void capture_frame(const uint32_t* buffer);
+bool capture_stop(void);
+void capture_rgb_to_ycbcr(uint32_t color, uint8_t ycbcr[3]);
+
+#endif
@@ -1,4 +1,6 @@
 #include "display.h"
+#include "kernels.h"
+#include "stats.h"
 
 // global vars
 SDL_Window* window = NULL;
@@ -98,30 +100,32 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
  * Draw a line on the screen using the DDA algorithm.
  */
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
-    int delta_x = (x1 - x0);
-    int delta_y = (y1 - y0);
-
-    // Set the counter to the longest side, whether it's x or y
-    int longest_side_length =
-        (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
-
-    // Calculate how much to increase x and y in each step.
-    // It casts one number to float, otherwise it will be integer
-    // division. Division is a slow operation, so if there are
-    // performance issues, we'll switch to Bresenham' algorithm.
-    float x_inc = delta_x / (float)longest_side_length;
-    float y_inc = delta_y / (float)longest_side_length;
-
-    float current_x = x0;
-    float current_y = y0;
-
-    for (int i = 0; i <= longest_side_length; i++) {
-        draw_pixel(round(current_x), round(current_y), color);
-        // The longer side increments by 1 (the longest side divided by
-        // the longest_side_length is 1), and other side increments by
-        // an amount that depends on the slope of the line.
-        current_x += x_inc;
-        current_y += y_inc;
+    kernels.draw_line(x0, y0, x1, y1, color);
+}
+
+/**
+ * Draw the pixels from x0 to x1 (inclusive, in either order) on row y.
+ * Triangle fills draw through here, so this is where their pixel writes
+ * are counted.
+ */
+void draw_span(int x0, int x1, int y, uint32_t color) {
+    if (x0 > x1) {
+        int tmp = x0;
+        x0 = x1;
+        x1 = tmp;
+    }
+    if (y < 0 || y >= window_height || x1 < 0 || x0 >= window_width) {
+        return;
+    }
+    if (x0 < 0) x0 = 0;
+    if (x1 >= window_width) x1 = window_width - 1;
+
+    int row = window_width * y;
+    kernels.fill_span(&color_buffer[row + x0], x1 - x0 + 1, color);
+    if (overdraw_buffer != NULL && is_counting_raster) {
+        for (int x = x0; x <= x1; x++) {
+            count_pixel_write(row + x);
+        }
     }
 }
 
@@ -129,12 +133,8 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
  * Set all the pixels in the window to the given color.
  */
 void clear_color_buffer(uint32_t color) {
-    for (int y = 0; y < window_height; y++) {
-        for (int x = 0; x < window_width; x++) {
-            // The pixels are in a single, linear array.
-            color_buffer[(window_width * y) + x] = color;
-        }
-    }
+    // The pixels are in a single, linear array.
+    kernels.fill_span(color_buffer, window_width * window_height, color);
 }
 
 void destroy_window(void) {
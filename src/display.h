@@ -15,7 +15,10 @@ enum render_method {
     RENDER_WIRE,
     RENDER_WIRE_VERTEX,
     RENDER_FILL_TRIANGLE,
-    RENDER_FILL_TRIANGLE_WIRE
+    RENDER_FILL_TRIANGLE_WIRE,
+    RENDER_TEXTURED,
+    RENDER_TEXTURED_WIRE,
+    RENDER_OVERDRAW  // filled triangles shown as a heatmap of pixel writes
 } render_method;
 
 extern SDL_Window* window;
@@ -34,6 +37,7 @@ void draw_rect(int x, int y, int width, int height, uint32_t color);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
                    uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+void draw_span(int x0, int x1, int y, uint32_t color);
 void render_color_buffer(void);
 
 #endif
@@ -0,0 +1,127 @@
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Read the next number from a PPM header, skipping whitespace and comments.
+ */
+static int read_ppm_header_value(FILE* file) {
+    int c = fgetc(file);
+    while (c != EOF) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') c = fgetc(file);
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            c = fgetc(file);
+        } else {
+            break;
+        }
+    }
+
+    int value = 0;
+    int digits = 0;
+    while (c >= '0' && c <= '9') {
+        value = (value * 10) + (c - '0');
+        digits++;
+        c = fgetc(file);
+    }
+
+    return digits > 0 ? value : -1;
+}
+
+/**
+ * Load a binary (P6) PPM file as row-major ARGB pixels. The caller frees
+ * the result.
+ */
+uint32_t* load_ppm_image(const char* filename, int* width, int* height) {
+    FILE* file = fopen(filename, "rb");
+
+    if (file == NULL) {
+        printf("file not found: %s\n", filename);
+        return NULL;
+    }
+
+    char magic[2];
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || magic[1] != '6') {
+        printf("not a binary PPM file: %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    // The single whitespace after max_value is consumed by the reader.
+    *width = read_ppm_header_value(file);
+    *height = read_ppm_header_value(file);
+    int max_value = read_ppm_header_value(file);
+    if (*width <= 0 || *height <= 0 || max_value <= 0 || max_value > 255) {
+        printf("unsupported PPM header: %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    size_t num_pixels = (size_t)*width * *height;
+    uint8_t* rgb = (uint8_t*)malloc(num_pixels * 3);
+    uint32_t* pixels = (uint32_t*)malloc(num_pixels * sizeof(uint32_t));
+
+    if (fread(rgb, 3, num_pixels, file) == num_pixels) {
+        for (size_t i = 0; i < num_pixels; i++) {
+            pixels[i] = 0xFF000000 | (rgb[i * 3] << 16) |
+                        (rgb[i * 3 + 1] << 8) | rgb[i * 3 + 2];
+        }
+    } else {
+        printf("truncated PPM file: %s\n", filename);
+        free(pixels);
+        pixels = NULL;
+    }
+
+    free(rgb);
+    fclose(file);
+    return pixels;
+}
+
+/**
+ * Save ARGB pixels as a binary (P6) PPM file. Alpha is dropped.
+ */
+bool save_ppm_image(const char* filename, const uint32_t* pixels, int width,
+                    int height) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        printf("cannot open file for writing: %s\n", filename);
+        return false;
+    }
+
+    size_t num_pixels = (size_t)width * height;
+    uint8_t* rgb = (uint8_t*)malloc(num_pixels * 3);
+    for (size_t i = 0; i < num_pixels; i++) {
+        rgb[i * 3] = (pixels[i] >> 16) & 0xFF;
+        rgb[i * 3 + 1] = (pixels[i] >> 8) & 0xFF;
+        rgb[i * 3 + 2] = pixels[i] & 0xFF;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool is_ok = fwrite(rgb, 3, num_pixels, file) == num_pixels;
+    free(rgb);
+    return fclose(file) == 0 && is_ok;
+}
+
+/**
+ * Compare two images pixel by pixel, ignoring alpha.
+ */
+image_diff_t diff_images(const uint32_t* a, const uint32_t* b,
+                         int num_pixels) {
+    image_diff_t diff = {.differing_pixels = 0, .max_channel_diff = 0};
+
+    for (int i = 0; i < num_pixels; i++) {
+        if (((a[i] ^ b[i]) & 0x00FFFFFF) == 0) {
+            continue;
+        }
+        diff.differing_pixels++;
+        for (int shift = 0; shift < 24; shift += 8) {
+            int channel_diff =
+                abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF));
+            if (channel_diff > diff.max_channel_diff) {
+                diff.max_channel_diff = channel_diff;
+            }
+        }
+    }
+
+    return diff;
+}
@@ -0,0 +1,18 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// How two images of the same size differ
+typedef struct {
+    int differing_pixels;
+    int max_channel_diff;  // largest difference in any one color channel
+} image_diff_t;
+
+uint32_t* load_ppm_image(const char* filename, int* width, int* height);
+bool save_ppm_image(const char* filename, const uint32_t* pixels, int width,
+                    int height);
+image_diff_t diff_images(const uint32_t* a, const uint32_t* b, int num_pixels);
+
+#endif
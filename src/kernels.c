@@ -0,0 +1,755 @@
+#include "kernels.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+
+// The SIMD variants are compiled with per-function target attributes, so
+// the Makefile can keep building for baseline x86-64. They only run after
+// SDL's CPUID checks say the CPU (and OS) supports them.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+static const char* level_names[NUM_KERNEL_LEVELS] = {"baseline", "sse4.1",
+                                                      "avx2", "avx512"};
+
+static kernel_level_t selected_level = KERNEL_BASELINE;
+
+/**
+ * Work out the sines and cosines of a rotation once, for a whole batch of
+ * vertices.
+ */
+vertex_transform_t make_vertex_transform(vec3_t rotation, vec3_t translation) {
+    vertex_transform_t transform = {.cos_x = cosf(rotation.x),
+                                    .sin_x = sinf(rotation.x),
+                                    .cos_y = cosf(rotation.y),
+                                    .sin_y = sinf(rotation.y),
+                                    .cos_z = cosf(rotation.z),
+                                    .sin_z = sinf(rotation.z),
+                                    .translation = translation};
+    return transform;
+}
+
+//////////////////////
+// Baseline kernels
+//////////////////////
+
+// The SIMD variants do the same float operations in the same order as
+// these, so every level gives the same results.
+
+static vec3_t transform_one(vec3_t v, const vertex_transform_t* t) {
+    // Rotate about x
+    float y1 = v.y * t->cos_x - v.z * t->sin_x;
+    float z1 = v.y * t->sin_x + v.z * t->cos_x;
+    // Rotate about y
+    float x2 = v.x * t->cos_y - z1 * t->sin_y;
+    float z2 = v.x * t->sin_y + z1 * t->cos_y;
+    // Rotate about z
+    float x3 = x2 * t->cos_z - y1 * t->sin_z;
+    float y3 = x2 * t->sin_z + y1 * t->cos_z;
+
+    vec3_t out = {.x = x3 + t->translation.x,
+                  .y = y3 + t->translation.y,
+                  .z = z2 + t->translation.z};
+    return out;
+}
+
+static void transform_vertices_baseline(const vec3_t* vertices, vec3_t* out,
+                                        size_t count,
+                                        const vertex_transform_t* transform) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = transform_one(vertices[i], transform);
+    }
+}
+
+/**
+ * Fold the dequantize step of 16-bit vertices into the transform: with
+ * position = offset + scale * q, the transform of the position is
+ * rotate(scale * q) + rotate(offset) + translation, which is one matrix
+ * applied to q plus one translation.
+ */
+vertex_matrix_t make_quantized_matrix(const vertex_transform_t* transform,
+                                      vec3_t scale, vec3_t offset) {
+    vertex_transform_t rotation = *transform;
+    rotation.translation = (vec3_t){0, 0, 0};
+
+    vec3_t columns[3] = {transform_one((vec3_t){scale.x, 0, 0}, &rotation),
+                         transform_one((vec3_t){0, scale.y, 0}, &rotation),
+                         transform_one((vec3_t){0, 0, scale.z}, &rotation)};
+    vertex_matrix_t matrix;
+    for (int j = 0; j < 3; j++) {
+        matrix.m[0][j] = columns[j].x;
+        matrix.m[1][j] = columns[j].y;
+        matrix.m[2][j] = columns[j].z;
+    }
+    matrix.translation = transform_one(offset, transform);
+    return matrix;
+}
+
+static vec3_t transform_quantized_one(qvec3_t q, const vertex_matrix_t* t) {
+    float in[3] = {q.x, q.y, q.z};
+    float out[3];
+    const float* moves = &t->translation.x;
+    for (int row = 0; row < 3; row++) {
+        float sum = t->m[row][0] * in[0];
+        sum += t->m[row][1] * in[1];
+        sum += t->m[row][2] * in[2];
+        out[row] = sum + moves[row];
+    }
+    return (vec3_t){out[0], out[1], out[2]};
+}
+
+static void transform_quantized_baseline(const qvec3_t* vertices, vec3_t* out,
+                                         size_t count,
+                                         const vertex_matrix_t* matrix) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = transform_quantized_one(vertices[i], matrix);
+    }
+}
+
+static void fill_span_baseline(uint32_t* pixels, int count, uint32_t color) {
+    for (int i = 0; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+/**
+ * Set up a DDA line: the number of steps along the longest side, and how
+ * far x and y move at each step. Returns false for a single point.
+ */
+static bool setup_line(int x0, int y0, int x1, int y1, int* num_steps,
+                       float* x_inc, float* y_inc) {
+    int delta_x = (x1 - x0);
+    int delta_y = (y1 - y0);
+
+    // Set the counter to the longest side, whether it's x or y
+    *num_steps = (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
+    if (*num_steps == 0) {
+        return false;
+    }
+
+    // The longer side increments by 1 (the longest side divided by the
+    // number of steps is 1), and the other side by an amount that depends
+    // on the slope of the line.
+    *x_inc = delta_x / (float)*num_steps;
+    *y_inc = delta_y / (float)*num_steps;
+    return true;
+}
+
+/**
+ * Draw a line with the DDA algorithm. Each point is found from its step
+ * number instead of by adding up the increments, so the steps don't depend
+ * on each other and the SIMD variants can work on several at once.
+ */
+static void draw_line_baseline(int x0, int y0, int x1, int y1,
+                               uint32_t color) {
+    int num_steps;
+    float x_inc, y_inc;
+    if (!setup_line(x0, y0, x1, y1, &num_steps, &x_inc, &y_inc)) {
+        draw_pixel(x0, y0, color);
+        return;
+    }
+
+    for (int i = 0; i <= num_steps; i++) {
+        draw_pixel(roundf(x0 + i * x_inc), roundf(y0 + i * y_inc), color);
+    }
+}
+
+#ifdef KERNELS_X86
+
+//////////////////////
+// SSE4.1 kernels
+//////////////////////
+
+/**
+ * Load 4 vertices and split them into x, y and z vectors.
+ */
+TARGET("sse4.1")
+static inline void load_vertices_sse41(const vec3_t* v, __m128* x, __m128* y,
+                                       __m128* z) {
+    const float* f = (const float*)v;
+    __m128 a = _mm_loadu_ps(f);      // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(f + 4);  // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(f + 8);  // z2 x3 y3 z3
+
+    __m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    *x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 3, 0));
+
+    __m128 t0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    *y = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+
+    t0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    t1 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+    *z = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/**
+ * Interleave x, y and z vectors back into 4 vertices.
+ */
+TARGET("sse4.1")
+static inline void store_vertices_sse41(vec3_t* v, __m128 x, __m128 y,
+                                        __m128 z) {
+    float* f = (float*)v;
+    __m128 p = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 q = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+    _mm_storeu_ps(f, _mm_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    p = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+    q = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+    _mm_storeu_ps(f + 4, _mm_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    p = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+    q = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(f + 8, _mm_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+TARGET("sse4.1")
+static void transform_vertices_sse41(const vec3_t* vertices, vec3_t* out,
+                                     size_t count,
+                                     const vertex_transform_t* t) {
+    __m128 cos_x = _mm_set1_ps(t->cos_x), sin_x = _mm_set1_ps(t->sin_x);
+    __m128 cos_y = _mm_set1_ps(t->cos_y), sin_y = _mm_set1_ps(t->sin_y);
+    __m128 cos_z = _mm_set1_ps(t->cos_z), sin_z = _mm_set1_ps(t->sin_z);
+    __m128 move_x = _mm_set1_ps(t->translation.x);
+    __m128 move_y = _mm_set1_ps(t->translation.y);
+    __m128 move_z = _mm_set1_ps(t->translation.z);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x, y, z;
+        load_vertices_sse41(&vertices[i], &x, &y, &z);
+
+        __m128 y1 = _mm_sub_ps(_mm_mul_ps(y, cos_x), _mm_mul_ps(z, sin_x));
+        __m128 z1 = _mm_add_ps(_mm_mul_ps(y, sin_x), _mm_mul_ps(z, cos_x));
+        __m128 x2 = _mm_sub_ps(_mm_mul_ps(x, cos_y), _mm_mul_ps(z1, sin_y));
+        __m128 z2 = _mm_add_ps(_mm_mul_ps(x, sin_y), _mm_mul_ps(z1, cos_y));
+        __m128 x3 = _mm_sub_ps(_mm_mul_ps(x2, cos_z), _mm_mul_ps(y1, sin_z));
+        __m128 y3 = _mm_add_ps(_mm_mul_ps(x2, sin_z), _mm_mul_ps(y1, cos_z));
+
+        store_vertices_sse41(&out[i], _mm_add_ps(x3, move_x),
+                             _mm_add_ps(y3, move_y), _mm_add_ps(z2, move_z));
+    }
+    for (; i < count; i++) {
+        out[i] = transform_one(vertices[i], t);
+    }
+}
+
+/**
+ * Load 8 quantized vertices (48 bytes, three 16-byte loads) and split them
+ * into x, y and z vectors of 8 16-bit values each.
+ */
+TARGET("sse4.1")
+static inline void load_quantized_sse41(const qvec3_t* v, __m128i* x,
+                                        __m128i* y, __m128i* z) {
+    const __m128i* p = (const __m128i*)v;
+    __m128i a = _mm_loadu_si128(p);
+    __m128i b = _mm_loadu_si128(p + 1);
+    __m128i c = _mm_loadu_si128(p + 2);
+
+    // Each shuffle picks one axis's bytes out of one load; -1 gives 0
+    *x = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(0, 1, 6, 7, 12, 13, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 3, 8,
+                                              9, 14, 15, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, -1, 4, 5, 10, 11)));
+    *y = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(2, 3, 8, 9, 14, 15, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 5, 10,
+                                              11, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, 0, 1, 6, 7, 12, 13)));
+    *z = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(4, 5, 10, 11, -1, -1, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, 0, 1, 6, 7, 12,
+                                              13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, 2, 3, 8, 9, 14, 15)));
+}
+
+/**
+ * Apply the matrix to 4 vertices, in the same order of operations as
+ * transform_quantized_one().
+ */
+TARGET("sse4.1")
+static inline void apply_matrix_sse41(vec3_t* out, __m128 x, __m128 y,
+                                      __m128 z, const vertex_matrix_t* t) {
+    __m128 out_xyz[3];
+    const float* moves = &t->translation.x;
+    for (int row = 0; row < 3; row++) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(t->m[row][0]), x);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(t->m[row][1]), y));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(t->m[row][2]), z));
+        out_xyz[row] = _mm_add_ps(sum, _mm_set1_ps(moves[row]));
+    }
+    store_vertices_sse41(out, out_xyz[0], out_xyz[1], out_xyz[2]);
+}
+
+TARGET("sse4.1")
+static void transform_quantized_sse41(const qvec3_t* vertices, vec3_t* out,
+                                      size_t count,
+                                      const vertex_matrix_t* matrix) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x, y, z;
+        load_quantized_sse41(&vertices[i], &x, &y, &z);
+        apply_matrix_sse41(&out[i], _mm_cvtepi32_ps(_mm_cvtepu16_epi32(x)),
+                           _mm_cvtepi32_ps(_mm_cvtepu16_epi32(y)),
+                           _mm_cvtepi32_ps(_mm_cvtepu16_epi32(z)), matrix);
+        apply_matrix_sse41(
+            &out[i + 4],
+            _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(x, 8))),
+            _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(y, 8))),
+            _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(z, 8))), matrix);
+    }
+    for (; i < count; i++) {
+        out[i] = transform_quantized_one(vertices[i], matrix);
+    }
+}
+
+TARGET("sse4.1")
+static void fill_span_sse41(uint32_t* pixels, int count, uint32_t color) {
+    __m128i colors = _mm_set1_epi32(color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)&pixels[i], colors);
+    }
+    for (; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+/**
+ * Round halfway cases away from zero, like roundf().
+ */
+TARGET("sse4.1")
+static inline __m128 round_sse41(__m128 v) {
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 whole = _mm_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128 fraction = _mm_andnot_ps(sign, _mm_sub_ps(v, whole));
+    __m128 is_up = _mm_cmpge_ps(fraction, _mm_set1_ps(0.5f));
+    __m128 one = _mm_or_ps(_mm_and_ps(v, sign), _mm_set1_ps(1.0f));
+    return _mm_add_ps(whole, _mm_and_ps(is_up, one));
+}
+
+TARGET("sse4.1")
+static void draw_line_sse41(int x0, int y0, int x1, int y1, uint32_t color) {
+    int num_steps;
+    float x_inc, y_inc;
+    if (!setup_line(x0, y0, x1, y1, &num_steps, &x_inc, &y_inc)) {
+        draw_pixel(x0, y0, color);
+        return;
+    }
+
+    __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+    __m128 start_x = _mm_set1_ps(x0), step_x = _mm_set1_ps(x_inc);
+    __m128 start_y = _mm_set1_ps(y0), step_y = _mm_set1_ps(y_inc);
+    int xs[4], ys[4];
+
+    for (int i = 0; i <= num_steps; i += 4) {
+        __m128 steps = _mm_add_ps(_mm_set1_ps(i), lanes);
+        __m128 x = _mm_add_ps(start_x, _mm_mul_ps(steps, step_x));
+        __m128 y = _mm_add_ps(start_y, _mm_mul_ps(steps, step_y));
+        _mm_storeu_si128((__m128i*)xs, _mm_cvttps_epi32(round_sse41(x)));
+        _mm_storeu_si128((__m128i*)ys, _mm_cvttps_epi32(round_sse41(y)));
+
+        int count = num_steps + 1 - i < 4 ? num_steps + 1 - i : 4;
+        for (int j = 0; j < count; j++) {
+            draw_pixel(xs[j], ys[j], color);
+        }
+    }
+}
+
+//////////////////////
+// AVX2 kernels
+//////////////////////
+
+TARGET("avx2")
+static void transform_vertices_avx2(const vec3_t* vertices, vec3_t* out,
+                                    size_t count,
+                                    const vertex_transform_t* t) {
+    __m256 cos_x = _mm256_set1_ps(t->cos_x), sin_x = _mm256_set1_ps(t->sin_x);
+    __m256 cos_y = _mm256_set1_ps(t->cos_y), sin_y = _mm256_set1_ps(t->sin_y);
+    __m256 cos_z = _mm256_set1_ps(t->cos_z), sin_z = _mm256_set1_ps(t->sin_z);
+    __m256 move_x = _mm256_set1_ps(t->translation.x);
+    __m256 move_y = _mm256_set1_ps(t->translation.y);
+    __m256 move_z = _mm256_set1_ps(t->translation.z);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Split each half with the 128-bit shuffles, which is cheaper than
+        // gathering across the whole register
+        __m128 x_lo, y_lo, z_lo, x_hi, y_hi, z_hi;
+        load_vertices_sse41(&vertices[i], &x_lo, &y_lo, &z_lo);
+        load_vertices_sse41(&vertices[i + 4], &x_hi, &y_hi, &z_hi);
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x_lo), x_hi, 1);
+        __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(y_lo), y_hi, 1);
+        __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(z_lo), z_hi, 1);
+
+        __m256 y1 =
+            _mm256_sub_ps(_mm256_mul_ps(y, cos_x), _mm256_mul_ps(z, sin_x));
+        __m256 z1 =
+            _mm256_add_ps(_mm256_mul_ps(y, sin_x), _mm256_mul_ps(z, cos_x));
+        __m256 x2 =
+            _mm256_sub_ps(_mm256_mul_ps(x, cos_y), _mm256_mul_ps(z1, sin_y));
+        __m256 z2 =
+            _mm256_add_ps(_mm256_mul_ps(x, sin_y), _mm256_mul_ps(z1, cos_y));
+        __m256 x3 =
+            _mm256_sub_ps(_mm256_mul_ps(x2, cos_z), _mm256_mul_ps(y1, sin_z));
+        __m256 y3 =
+            _mm256_add_ps(_mm256_mul_ps(x2, sin_z), _mm256_mul_ps(y1, cos_z));
+
+        x = _mm256_add_ps(x3, move_x);
+        y = _mm256_add_ps(y3, move_y);
+        z = _mm256_add_ps(z2, move_z);
+        store_vertices_sse41(&out[i], _mm256_castps256_ps128(x),
+                             _mm256_castps256_ps128(y),
+                             _mm256_castps256_ps128(z));
+        store_vertices_sse41(&out[i + 4], _mm256_extractf128_ps(x, 1),
+                             _mm256_extractf128_ps(y, 1),
+                             _mm256_extractf128_ps(z, 1));
+    }
+    for (; i < count; i++) {
+        out[i] = transform_one(vertices[i], t);
+    }
+}
+
+TARGET("avx2")
+static void transform_quantized_avx2(const qvec3_t* vertices, vec3_t* out,
+                                     size_t count,
+                                     const vertex_matrix_t* matrix) {
+    const float* moves = &matrix->translation.x;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i xq, yq, zq;
+        load_quantized_sse41(&vertices[i], &xq, &yq, &zq);
+        __m256 in[3] = {_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(xq)),
+                        _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(yq)),
+                        _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(zq))};
+
+        __m256 out_xyz[3];
+        for (int row = 0; row < 3; row++) {
+            __m256 sum =
+                _mm256_mul_ps(_mm256_set1_ps(matrix->m[row][0]), in[0]);
+            sum = _mm256_add_ps(
+                sum, _mm256_mul_ps(_mm256_set1_ps(matrix->m[row][1]), in[1]));
+            sum = _mm256_add_ps(
+                sum, _mm256_mul_ps(_mm256_set1_ps(matrix->m[row][2]), in[2]));
+            out_xyz[row] = _mm256_add_ps(sum, _mm256_set1_ps(moves[row]));
+        }
+
+        store_vertices_sse41(&out[i], _mm256_castps256_ps128(out_xyz[0]),
+                             _mm256_castps256_ps128(out_xyz[1]),
+                             _mm256_castps256_ps128(out_xyz[2]));
+        store_vertices_sse41(&out[i + 4], _mm256_extractf128_ps(out_xyz[0], 1),
+                             _mm256_extractf128_ps(out_xyz[1], 1),
+                             _mm256_extractf128_ps(out_xyz[2], 1));
+    }
+    for (; i < count; i++) {
+        out[i] = transform_quantized_one(vertices[i], matrix);
+    }
+}
+
+TARGET("avx2")
+static void fill_span_avx2(uint32_t* pixels, int count, uint32_t color) {
+    __m256i colors = _mm256_set1_epi32(color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)&pixels[i], colors);
+    }
+    for (; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+TARGET("avx2")
+static inline __m256 round_avx2(__m256 v) {
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 whole = _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256 fraction = _mm256_andnot_ps(sign, _mm256_sub_ps(v, whole));
+    __m256 is_up = _mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+    __m256 one = _mm256_or_ps(_mm256_and_ps(v, sign), _mm256_set1_ps(1.0f));
+    return _mm256_add_ps(whole, _mm256_and_ps(is_up, one));
+}
+
+TARGET("avx2")
+static void draw_line_avx2(int x0, int y0, int x1, int y1, uint32_t color) {
+    int num_steps;
+    float x_inc, y_inc;
+    if (!setup_line(x0, y0, x1, y1, &num_steps, &x_inc, &y_inc)) {
+        draw_pixel(x0, y0, color);
+        return;
+    }
+
+    __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 start_x = _mm256_set1_ps(x0), step_x = _mm256_set1_ps(x_inc);
+    __m256 start_y = _mm256_set1_ps(y0), step_y = _mm256_set1_ps(y_inc);
+    int xs[8], ys[8];
+
+    for (int i = 0; i <= num_steps; i += 8) {
+        __m256 steps = _mm256_add_ps(_mm256_set1_ps(i), lanes);
+        __m256 x = _mm256_add_ps(start_x, _mm256_mul_ps(steps, step_x));
+        __m256 y = _mm256_add_ps(start_y, _mm256_mul_ps(steps, step_y));
+        _mm256_storeu_si256((__m256i*)xs, _mm256_cvttps_epi32(round_avx2(x)));
+        _mm256_storeu_si256((__m256i*)ys, _mm256_cvttps_epi32(round_avx2(y)));
+
+        int count = num_steps + 1 - i < 8 ? num_steps + 1 - i : 8;
+        for (int j = 0; j < count; j++) {
+            draw_pixel(xs[j], ys[j], color);
+        }
+    }
+}
+
+//////////////////////
+// AVX-512 kernels
+//////////////////////
+
+TARGET("avx512f")
+static void transform_vertices_avx512(const vec3_t* vertices, vec3_t* out,
+                                      size_t count,
+                                      const vertex_transform_t* t) {
+    __m512 cos_x = _mm512_set1_ps(t->cos_x), sin_x = _mm512_set1_ps(t->sin_x);
+    __m512 cos_y = _mm512_set1_ps(t->cos_y), sin_y = _mm512_set1_ps(t->sin_y);
+    __m512 cos_z = _mm512_set1_ps(t->cos_z), sin_z = _mm512_set1_ps(t->sin_z);
+    __m512 move_x = _mm512_set1_ps(t->translation.x);
+    __m512 move_y = _mm512_set1_ps(t->translation.y);
+    __m512 move_z = _mm512_set1_ps(t->translation.z);
+
+    // Offsets in floats of each vertex's x in a block of 16
+    __m512i offsets = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30,
+                                        33, 36, 39, 42, 45);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const float* in = (const float*)&vertices[i];
+        __m512 x = _mm512_i32gather_ps(offsets, in, 4);
+        __m512 y = _mm512_i32gather_ps(offsets, in + 1, 4);
+        __m512 z = _mm512_i32gather_ps(offsets, in + 2, 4);
+
+        __m512 y1 =
+            _mm512_sub_ps(_mm512_mul_ps(y, cos_x), _mm512_mul_ps(z, sin_x));
+        __m512 z1 =
+            _mm512_add_ps(_mm512_mul_ps(y, sin_x), _mm512_mul_ps(z, cos_x));
+        __m512 x2 =
+            _mm512_sub_ps(_mm512_mul_ps(x, cos_y), _mm512_mul_ps(z1, sin_y));
+        __m512 z2 =
+            _mm512_add_ps(_mm512_mul_ps(x, sin_y), _mm512_mul_ps(z1, cos_y));
+        __m512 x3 =
+            _mm512_sub_ps(_mm512_mul_ps(x2, cos_z), _mm512_mul_ps(y1, sin_z));
+        __m512 y3 =
+            _mm512_add_ps(_mm512_mul_ps(x2, sin_z), _mm512_mul_ps(y1, cos_z));
+
+        float* dest = (float*)&out[i];
+        _mm512_i32scatter_ps(dest, offsets, _mm512_add_ps(x3, move_x), 4);
+        _mm512_i32scatter_ps(dest + 1, offsets, _mm512_add_ps(y3, move_y), 4);
+        _mm512_i32scatter_ps(dest + 2, offsets, _mm512_add_ps(z2, move_z), 4);
+    }
+    for (; i < count; i++) {
+        out[i] = transform_one(vertices[i], t);
+    }
+}
+
+TARGET("avx512f")
+static void transform_quantized_avx512(const qvec3_t* vertices, vec3_t* out,
+                                       size_t count,
+                                       const vertex_matrix_t* matrix) {
+    const float* moves = &matrix->translation.x;
+    __m512i offsets = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30,
+                                        33, 36, 39, 42, 45);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo[3], hi[3];
+        load_quantized_sse41(&vertices[i], &lo[0], &lo[1], &lo[2]);
+        load_quantized_sse41(&vertices[i + 8], &hi[0], &hi[1], &hi[2]);
+        __m512 in[3];
+        for (int axis = 0; axis < 3; axis++) {
+            __m256i both = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(lo[axis]), hi[axis], 1);
+            in[axis] = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(both));
+        }
+
+        float* dest = (float*)&out[i];
+        for (int row = 0; row < 3; row++) {
+            __m512 sum =
+                _mm512_mul_ps(_mm512_set1_ps(matrix->m[row][0]), in[0]);
+            sum = _mm512_add_ps(
+                sum, _mm512_mul_ps(_mm512_set1_ps(matrix->m[row][1]), in[1]));
+            sum = _mm512_add_ps(
+                sum, _mm512_mul_ps(_mm512_set1_ps(matrix->m[row][2]), in[2]));
+            sum = _mm512_add_ps(sum, _mm512_set1_ps(moves[row]));
+            _mm512_i32scatter_ps(dest + row, offsets, sum, 4);
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = transform_quantized_one(vertices[i], matrix);
+    }
+}
+
+TARGET("avx512f")
+static void fill_span_avx512(uint32_t* pixels, int count, uint32_t color) {
+    __m512i colors = _mm512_set1_epi32(color);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512(&pixels[i], colors);
+    }
+    if (i < count) {
+        __mmask16 tail = (__mmask16)((1u << (count - i)) - 1);
+        _mm512_mask_storeu_epi32(&pixels[i], tail, colors);
+    }
+}
+
+TARGET("avx512f")
+static inline __m512 round_avx512(__m512 v) {
+    __m512i sign = _mm512_set1_epi32(0x80000000);
+    __m512 whole = _mm512_roundscale_ps(v, _MM_FROUND_TO_ZERO);
+    __m512 fraction = _mm512_abs_ps(_mm512_sub_ps(v, whole));
+    __mmask16 is_up =
+        _mm512_cmp_ps_mask(fraction, _mm512_set1_ps(0.5f), _CMP_GE_OQ);
+    __m512 one = _mm512_castsi512_ps(
+        _mm512_or_epi32(_mm512_and_epi32(_mm512_castps_si512(v), sign),
+                        _mm512_castps_si512(_mm512_set1_ps(1.0f))));
+    return _mm512_mask_add_ps(whole, is_up, whole, one);
+}
+
+TARGET("avx512f")
+static void draw_line_avx512(int x0, int y0, int x1, int y1, uint32_t color) {
+    int num_steps;
+    float x_inc, y_inc;
+    if (!setup_line(x0, y0, x1, y1, &num_steps, &x_inc, &y_inc)) {
+        draw_pixel(x0, y0, color);
+        return;
+    }
+
+    __m512 lanes = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                  13, 14, 15);
+    __m512 start_x = _mm512_set1_ps(x0), step_x = _mm512_set1_ps(x_inc);
+    __m512 start_y = _mm512_set1_ps(y0), step_y = _mm512_set1_ps(y_inc);
+    __m512i width = _mm512_set1_epi32(window_width);
+    __m512i height = _mm512_set1_epi32(window_height);
+    __m512i zero = _mm512_setzero_si512();
+    __m512i colors = _mm512_set1_epi32(color);
+
+    for (int i = 0; i <= num_steps; i += 16) {
+        __m512 steps = _mm512_add_ps(_mm512_set1_ps(i), lanes);
+        __m512 x = _mm512_add_ps(start_x, _mm512_mul_ps(steps, step_x));
+        __m512 y = _mm512_add_ps(start_y, _mm512_mul_ps(steps, step_y));
+        __m512i xi = _mm512_cvttps_epi32(round_avx512(x));
+        __m512i yi = _mm512_cvttps_epi32(round_avx512(y));
+
+        int count = num_steps + 1 - i < 16 ? num_steps + 1 - i : 16;
+
+        // Scatter the points that land on the screen
+        __mmask16 mask = (__mmask16)(count == 16 ? 0xFFFF : (1u << count) - 1);
+        mask &= _mm512_cmpge_epi32_mask(xi, zero);
+        mask &= _mm512_cmplt_epi32_mask(xi, width);
+        mask &= _mm512_cmpge_epi32_mask(yi, zero);
+        mask &= _mm512_cmplt_epi32_mask(yi, height);
+        __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(yi, width), xi);
+        _mm512_mask_i32scatter_epi32(color_buffer, mask, index, colors, 4);
+    }
+}
+
+#endif
+
+//////////////////////
+// Dispatch
+//////////////////////
+
+kernel_table_t kernels = {.transform_vertices = transform_vertices_baseline,
+                          .transform_quantized = transform_quantized_baseline,
+                          .fill_span = fill_span_baseline,
+                          .draw_line = draw_line_baseline};
+
+/**
+ * Check with CPUID (through SDL, which also checks that the OS saves the
+ * wider registers) whether this machine can run a kernel level.
+ */
+bool kernels_is_supported(kernel_level_t level) {
+    switch (level) {
+        case KERNEL_BASELINE:
+            return true;
+#ifdef KERNELS_X86
+        case KERNEL_SSE41:
+            return SDL_HasSSE41();
+        case KERNEL_AVX2:
+            return SDL_HasAVX2();
+        case KERNEL_AVX512:
+            return SDL_HasAVX512F();
+#endif
+        default:
+            return false;
+    }
+}
+
+kernel_level_t kernels_best_level(void) {
+    kernel_level_t best = KERNEL_BASELINE;
+    for (int level = 0; level < NUM_KERNEL_LEVELS; level++) {
+        if (kernels_is_supported(level)) {
+            best = level;
+        }
+    }
+    return best;
+}
+
+/**
+ * Point the kernel table at one level's variants. An unsupported level
+ * falls back to the best one below it.
+ */
+void kernels_select(kernel_level_t level) {
+    while (level > KERNEL_BASELINE && !kernels_is_supported(level)) {
+        level--;
+    }
+    selected_level = level;
+
+    kernel_table_t table = {.transform_vertices = transform_vertices_baseline,
+                            .transform_quantized = transform_quantized_baseline,
+                            .fill_span = fill_span_baseline,
+                            .draw_line = draw_line_baseline};
+#ifdef KERNELS_X86
+    if (level == KERNEL_SSE41) {
+        table.transform_vertices = transform_vertices_sse41;
+        table.transform_quantized = transform_quantized_sse41;
+        table.fill_span = fill_span_sse41;
+        table.draw_line = draw_line_sse41;
+    } else if (level == KERNEL_AVX2) {
+        table.transform_vertices = transform_vertices_avx2;
+        table.transform_quantized = transform_quantized_avx2;
+        table.fill_span = fill_span_avx2;
+        table.draw_line = draw_line_avx2;
+    } else if (level == KERNEL_AVX512) {
+        table.transform_vertices = transform_vertices_avx512;
+        table.transform_quantized = transform_quantized_avx512;
+        table.fill_span = fill_span_avx512;
+        table.draw_line = draw_line_avx512;
+    }
+#endif
+    kernels = table;
+}
+
+kernel_level_t kernels_level(void) { return selected_level; }
+
+const char* kernel_level_name(kernel_level_t level) {
+    return level_names[level];
+}
+
+bool kernel_level_from_name(const char* name, kernel_level_t* level) {
+    for (int i = 0; i < NUM_KERNEL_LEVELS; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
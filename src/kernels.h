@@ -0,0 +1,59 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vector.h"
+
+// Instruction set levels of the hot kernels, from slowest to fastest
+typedef enum {
+    KERNEL_BASELINE,  // plain C for any x86-64 (or other) CPU
+    KERNEL_SSE41,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    NUM_KERNEL_LEVELS
+} kernel_level_t;
+
+// Rotation about x, then y, then z, followed by a translation. The sines
+// and cosines are worked out once per frame instead of once per vertex.
+typedef struct {
+    float cos_x, sin_x;
+    float cos_y, sin_y;
+    float cos_z, sin_z;
+    vec3_t translation;
+} vertex_transform_t;
+
+// A general 3x3 matrix and translation: out = m * v + translation. Used
+// for quantized vertices, with the dequantize scale and offset folded in.
+typedef struct {
+    float m[3][3];
+    vec3_t translation;
+} vertex_matrix_t;
+
+// One variant of each kernel. Every variant draws the same pixels.
+typedef struct {
+    void (*transform_vertices)(const vec3_t* vertices, vec3_t* out,
+                               size_t count,
+                               const vertex_transform_t* transform);
+    void (*transform_quantized)(const qvec3_t* vertices, vec3_t* out,
+                                size_t count, const vertex_matrix_t* matrix);
+    void (*fill_span)(uint32_t* pixels, int count, uint32_t color);
+    void (*draw_line)(int x0, int y0, int x1, int y1, uint32_t color);
+} kernel_table_t;
+
+// The selected variants. Call through this table.
+extern kernel_table_t kernels;
+
+vertex_transform_t make_vertex_transform(vec3_t rotation, vec3_t translation);
+vertex_matrix_t make_quantized_matrix(const vertex_transform_t* transform,
+                                      vec3_t scale, vec3_t offset);
+
+bool kernels_is_supported(kernel_level_t level);
+kernel_level_t kernels_best_level(void);
+void kernels_select(kernel_level_t level);
+kernel_level_t kernels_level(void);
+const char* kernel_level_name(kernel_level_t level);
+bool kernel_level_from_name(const char* name, kernel_level_t* level);
+
+#endif
@@ -0,0 +1,190 @@
+#include "loader.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "array.h"
+
+// The loader thread builds a complete mesh_t off to the side, then parks it
+// in `pending` for the render loop to pick up between frames. After the
+// first load it keeps polling the file and reloads it when it changes.
+static struct {
+    char filename[1024];
+    bool is_quantizing;  // store the loaded meshes' vertices in 16 bits
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* wake;
+    bool is_stopping;
+    mesh_t* pending;  // finished mesh waiting for loader_take_mesh()
+} loader;
+
+// Identifies a version of the file on disk
+typedef struct {
+    bool exists;
+    long mtime;
+    long size;
+} file_stamp_t;
+
+static file_stamp_t get_file_stamp(const char* filename) {
+    file_stamp_t stamp = {.exists = false, .mtime = 0, .size = 0};
+    struct stat info;
+    if (stat(filename, &info) == 0) {
+        stamp.exists = true;
+        stamp.mtime = (long)info.st_mtime;
+        stamp.size = (long)info.st_size;
+    }
+    return stamp;
+}
+
+static bool stamps_equal(file_stamp_t a, file_stamp_t b) {
+    return a.exists == b.exists && a.mtime == b.mtime && a.size == b.size;
+}
+
+/**
+ * Load the file into a fresh mesh and hand it over, replacing any mesh the
+ * render loop hasn't picked up yet.
+ */
+static void load_and_publish(void) {
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    mesh_t* loaded_mesh = (mesh_t*)calloc(1, sizeof(mesh_t));
+    if (!load_obj_file_data(loaded_mesh, loader.filename)) {
+        free_mesh(loaded_mesh);
+        free(loaded_mesh);
+        return;
+    }
+    build_mesh_wireframe(loaded_mesh);
+    compute_mesh_bounds(loaded_mesh);
+    if (loader.is_quantizing) {
+        quantize_mesh_vertices(loaded_mesh);
+    }
+
+    // The render loop may free the mesh as soon as it's published
+    size_t num_vertices = mesh_vertex_count(loaded_mesh);
+    size_t num_faces = array_length(loaded_mesh->faces);
+
+    SDL_LockMutex(loader.lock);
+    mesh_t* stale_mesh = loader.pending;
+    loader.pending = loaded_mesh;
+    SDL_UnlockMutex(loader.lock);
+
+    if (stale_mesh != NULL) {
+        free_mesh(stale_mesh);
+        free(stale_mesh);
+    }
+
+    // Wake the render loop in case it's idle in SDL_WaitEvent()
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+
+    double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 /
+                SDL_GetPerformanceFrequency();
+    printf("loaded %s: %zu vertices, %zu faces in %.1f ms\n", loader.filename,
+           num_vertices, num_faces, ms);
+}
+
+static int loader_thread(void* data) {
+    (void)data;
+    file_stamp_t loaded_stamp = get_file_stamp(loader.filename);
+    load_and_publish();
+
+    // A change is only loaded once the stamp has held still for a whole
+    // poll interval, so files that are still being written are skipped.
+    file_stamp_t previous_stamp = loaded_stamp;
+
+    SDL_LockMutex(loader.lock);
+    while (!loader.is_stopping) {
+        SDL_CondWaitTimeout(loader.wake, loader.lock, LOADER_POLL_INTERVAL);
+        if (loader.is_stopping) {
+            break;
+        }
+        SDL_UnlockMutex(loader.lock);
+
+        file_stamp_t stamp = get_file_stamp(loader.filename);
+        if (stamp.exists && !stamps_equal(stamp, loaded_stamp) &&
+            stamps_equal(stamp, previous_stamp)) {
+            loaded_stamp = stamp;
+            load_and_publish();
+        }
+        previous_stamp = stamp;
+
+        SDL_LockMutex(loader.lock);
+    }
+    SDL_UnlockMutex(loader.lock);
+
+    return 0;
+}
+
+/**
+ * Start loading an obj file on a background thread, then keep watching it
+ * and reload it whenever it changes. With is_quantizing, each loaded mesh
+ * gets 16-bit vertices before it's handed over.
+ */
+bool loader_start(const char* filename, bool is_quantizing) {
+    if (loader.thread != NULL) {
+        return false;
+    }
+
+    snprintf(loader.filename, sizeof(loader.filename), "%s", filename);
+    loader.is_quantizing = is_quantizing;
+    loader.is_stopping = false;
+    loader.pending = NULL;
+    loader.lock = SDL_CreateMutex();
+    loader.wake = SDL_CreateCond();
+    loader.thread = SDL_CreateThread(loader_thread, "loader", NULL);
+    if (loader.thread == NULL) {
+        fprintf(stderr, "Error creating loader thread: %s\n", SDL_GetError());
+        SDL_DestroyCond(loader.wake);
+        SDL_DestroyMutex(loader.lock);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Take the newest finished mesh, if there is one. Call this from the render
+ * loop between frames; the mesh then belongs to the caller.
+ */
+bool loader_take_mesh(mesh_t* loaded_mesh) {
+    if (loader.thread == NULL) {
+        return false;
+    }
+
+    SDL_LockMutex(loader.lock);
+    mesh_t* pending = loader.pending;
+    loader.pending = NULL;
+    SDL_UnlockMutex(loader.lock);
+
+    if (pending == NULL) {
+        return false;
+    }
+
+    *loaded_mesh = *pending;
+    free(pending);
+    return true;
+}
+
+void loader_stop(void) {
+    if (loader.thread == NULL) {
+        return;
+    }
+
+    SDL_LockMutex(loader.lock);
+    loader.is_stopping = true;
+    SDL_CondSignal(loader.wake);
+    SDL_UnlockMutex(loader.lock);
+    SDL_WaitThread(loader.thread, NULL);
+    loader.thread = NULL;
+
+    if (loader.pending != NULL) {
+        free_mesh(loader.pending);
+        free(loader.pending);
+        loader.pending = NULL;
+    }
+    SDL_DestroyCond(loader.wake);
+    SDL_DestroyMutex(loader.lock);
+}
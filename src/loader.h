@@ -0,0 +1,16 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+// The loader pushes an SDL_USEREVENT whenever a new mesh is ready.
+
+// How often the loader thread checks the obj file for changes
+#define LOADER_POLL_INTERVAL 250
+
+bool loader_start(const char* filename, bool is_quantizing);
+bool loader_take_mesh(mesh_t* loaded_mesh);
+void loader_stop(void);
+
+#endif
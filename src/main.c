@@ -2,10 +2,20 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "array.h"
+#include "capture.h"
 #include "display.h"
+#include "image.h"
+#include "kernels.h"
+#include "loader.h"
 #include "mesh.h"
+#include "occlusion.h"
+#include "shm_output.h"
+#include "stats.h"
+#include "texture.h"
 #include "vector.h"
+#include "workers.h"
 
 ///////////////////////
 // Palette Reference //
@@ -27,48 +37,200 @@ vec3_t camera_position = {.x = 0, .y = 0, .z = 0};
 
 float fov_factor = 640;  // Field of view factor
 
-void setup(void) {
+// An obj file to load in the background and hot-reload, or NULL for the cube
+char* mesh_filename = NULL;
+
+// A binary PPM file to texture the mesh with, or NULL for a checkerboard
+char* texture_filename = NULL;
+
+// Static occluder geometry, in the same space as the mesh but not rotated.
+// Occluders are drawn in gray and hide the mesh when it's fully behind them.
+char* occluder_filename = NULL;
+mesh_t occluder_mesh = {0};
+triangle_t* occluder_triangles = NULL;
+bool is_occlusion_culling = true;
+
+// In on-demand mode a frame is only drawn when something on screen changed,
+// as tracked by is_scene_dirty. Otherwise the loop waits for events.
+bool is_on_demand = false;
+bool is_scene_dirty = true;
+bool is_rotating = true;
+
+// Print the raster counters after every frame
+bool is_printing_stats = false;
+
+// Store the mesh's vertices as 16-bit steps across its bounding box
+bool is_quantizing = false;
+
+// Name of a shared memory ring to draw the frames into, for other processes
+// to read, or NULL to keep the color buffer private
+char* shm_name = NULL;
+int shm_num_frames = SHM_OUTPUT_DEFAULT_FRAMES;
+
+// View space depth of the mesh's bounding box center, for ordering the mesh
+// against the occluders
+float mesh_center_depth = 0;
+
+// Draw with the plain reference code instead of the fast paths. The --verify
+// mode renders every test frame both ways and compares them.
+bool is_reference_path = false;
+
+// The fast geometry stage splits the vertices and faces into slices of
+// about this many faces, run as tasks on the worker pool
+#define GEOMETRY_FACES_PER_SLICE 2048
+#define GEOMETRY_MAX_SLICES 256
+
+typedef struct {
+    triangle_t* triangles;  // dynamic array of the slice's visible faces
+    int faces_culled;
+    size_t offset;  // where the slice's triangles go in triangles_to_render
+} geometry_slice_t;
+
+geometry_slice_t geometry_slices[GEOMETRY_MAX_SLICES];
+int num_geometry_slices = 0;
+int geometry_faces_per_slice = GEOMETRY_FACES_PER_SLICE;
+vertex_transform_t geometry_transform;
+vertex_matrix_t geometry_matrix;  // for quantized meshes
+
+// Size of the frames rendered by --verify, fixed so goldens stay comparable
+#define VERIFY_WIDTH 640
+#define VERIFY_HEIGHT 480
+
+/**
+ * Returns false if the shared memory ring was asked for but can't be
+ * created. Readers would wait on it forever, so there's no fallback.
+ */
+bool setup(void) {
     render_method = RENDER_WIRE;
     cull_method = CULL_BACKFACE;
 
-    // Allocate the required memory in bytes to hold the color buffer
-    color_buffer =
-        (uint32_t*)malloc(sizeof(uint32_t) * window_width * window_height);
+    // Allocate the required memory in bytes to hold the color buffer, in
+    // the shared memory ring if there is one
+    if (shm_name != NULL) {
+        color_buffer = shm_output_start(shm_name, window_width, window_height,
+                                        shm_num_frames);
+        if (color_buffer == NULL) {
+            printf("cannot share frames in %s\n", shm_name);
+            return false;
+        }
+    } else {
+        color_buffer =
+            (uint32_t*)malloc(sizeof(uint32_t) * window_width * window_height);
+    }
 
     // Create an SDL texture to display the color
     color_buffer_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
                                              SDL_TEXTUREACCESS_STREAMING,
                                              window_width, window_height);
 
-    load_cube_mesh_data();
-    // load_obj_file_data("./assets/f22.obj");
+    // The cube shows until the obj file (if any) finishes loading
+    load_cube_mesh_data(&mesh);
+    build_mesh_wireframe(&mesh);
+
+    // Load the PPM texture if there is one, otherwise use a checkerboard
+    if (texture_filename != NULL) {
+        mesh.texture = load_ppm_texture(texture_filename);
+    }
+    if (mesh.texture == NULL) {
+        mesh.texture = create_checker_texture(256, 0xFFF1C232, 0xFF000F89);
+    }
+
+    compute_mesh_bounds(&mesh);
+    if (is_quantizing) {
+        quantize_mesh_vertices(&mesh);
+    }
+
+    if (mesh_filename != NULL) {
+        loader_start(mesh_filename, is_quantizing);
+    }
+
+    if (occluder_filename != NULL &&
+        load_obj_file_data(&occluder_mesh, occluder_filename)) {
+        build_mesh_wireframe(&occluder_mesh);
+    }
+    return true;
 }
 
-void process_input(void) {
-    SDL_Event event;
-    SDL_PollEvent(&event);
+/**
+ * Swap in a mesh from the background loader, if one is ready. This runs
+ * between frames, so a frame never sees half of each mesh. The rotation
+ * and texture carry over to the new mesh.
+ */
+void swap_loaded_mesh(void) {
+    mesh_t loaded_mesh;
+    if (!loader_take_mesh(&loaded_mesh)) {
+        return;
+    }
+
+    loaded_mesh.rotation = mesh.rotation;
+    loaded_mesh.texture = mesh.texture;
+    mesh.texture = NULL;
+    free_mesh(&mesh);
+    mesh = loaded_mesh;
+    is_scene_dirty = true;
+}
 
-    switch (event.type) {
+void handle_event(SDL_Event* event) {
+    switch (event->type) {
         case SDL_QUIT:
             is_running = false;
             break;
+        case SDL_WINDOWEVENT:
+            // The window may have been uncovered or resized
+            is_scene_dirty = true;
+            break;
+        case SDL_USEREVENT:
+            // The loader has a new mesh, swap_loaded_mesh() picks it up
+            is_scene_dirty = true;
+            break;
         case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE) is_running = false;
+            // Every key below changes what's on screen
+            is_scene_dirty = true;
+            if (event->key.keysym.sym == SDLK_ESCAPE) is_running = false;
             // Also quit on q
-            if (event.key.keysym.sym == SDLK_q) is_running = false;
-            if (event.key.keysym.sym == SDLK_1)
+            if (event->key.keysym.sym == SDLK_q) is_running = false;
+            if (event->key.keysym.sym == SDLK_1)
                 render_method = RENDER_WIRE_VERTEX;
-            if (event.key.keysym.sym == SDLK_2) render_method = RENDER_WIRE;
-            if (event.key.keysym.sym == SDLK_3)
+            if (event->key.keysym.sym == SDLK_2) render_method = RENDER_WIRE;
+            if (event->key.keysym.sym == SDLK_3)
                 render_method = RENDER_FILL_TRIANGLE;
-            if (event.key.keysym.sym == SDLK_4)
+            if (event->key.keysym.sym == SDLK_4)
                 render_method = RENDER_FILL_TRIANGLE_WIRE;
-            if (event.key.keysym.sym == SDLK_c) cull_method = CULL_BACKFACE;
-            if (event.key.keysym.sym == SDLK_d) cull_method = CULL_NONE;
+            if (event->key.keysym.sym == SDLK_5)
+                render_method = RENDER_TEXTURED;
+            if (event->key.keysym.sym == SDLK_6)
+                render_method = RENDER_TEXTURED_WIRE;
+            if (event->key.keysym.sym == SDLK_7)
+                render_method = RENDER_OVERDRAW;
+            if (event->key.keysym.sym == SDLK_c) cull_method = CULL_BACKFACE;
+            if (event->key.keysym.sym == SDLK_d) cull_method = CULL_NONE;
+            if (event->key.keysym.sym == SDLK_o)
+                is_occlusion_culling = !is_occlusion_culling;
+            if (event->key.keysym.sym == SDLK_p) is_rotating = !is_rotating;
             break;
     }
 }
 
+/**
+ * Handle every pending event, so input never queues up behind slow frames.
+ *
+ * In on-demand mode, when the next frame would look the same as the last
+ * one, this sleeps in SDL_WaitEvent() until something happens instead.
+ */
+void process_input(void) {
+    SDL_Event event;
+
+    if (is_on_demand && !is_scene_dirty && !is_rotating) {
+        if (SDL_WaitEvent(&event)) {
+            handle_event(&event);
+        }
+    }
+
+    while (SDL_PollEvent(&event)) {
+        handle_event(&event);
+    }
+}
+
 /**
  * Project 3D info on a screen (2D).
  *
@@ -80,82 +242,204 @@ vec2_t project(vec3_t point) {
     return projected_point;
 }
 
-void update(void) {
-    // This locks the execution to match the desired FPS.
-    int time_to_wait =
-        FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
+/**
+ * Rotate a mesh vertex and move it in front of the camera.
+ */
+vec3_t transform_vertex(vec3_t vertex) {
+    vertex = vec3_rotate_x(vertex, mesh.rotation.x);
+    vertex = vec3_rotate_y(vertex, mesh.rotation.y);
+    vertex = vec3_rotate_z(vertex, mesh.rotation.z);
 
-    if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
-        SDL_Delay(time_to_wait);
-    }
+    // Translate the vertex away from the camera
+    vertex.z += 5;
 
-    previous_frame_time = SDL_GetTicks();
+    return vertex;
+}
 
-    // Initialize the array of triangles to render
-    triangles_to_render = NULL;  // reset
+/**
+ * Find the corner of a face that isn't a or b.
+ */
+int third_corner(face_t face, int a, int b) {
+    if (face.a != a && face.a != b) return face.a;
+    if (face.b != a && face.b != b) return face.b;
+    return face.c;
+}
 
-    mesh.rotation.x += 0.01;
-    mesh.rotation.y += 0.005;
-    mesh.rotation.z += 0.0001;
+/**
+ * Check whether an occluder edge is inside the occluders on screen: it
+ * joins two drawn faces that lie on opposite sides of it. Every other edge
+ * is part of the silhouette.
+ */
+bool is_occluder_edge_inside(edge_t edge) {
+    if (edge.face_b == NO_FACE || !occluder_mesh.face_visible[edge.face_a] ||
+        !occluder_mesh.face_visible[edge.face_b]) {
+        return false;
+    }
 
-    // Loop over all the triangle faces of the mesh
-    int num_faces = array_length(mesh.faces);
-    for (int i = 0; i < num_faces; i++) {
-        face_t mesh_face = mesh.faces[i];
+    vec2_t a = occluder_mesh.projected_vertices[edge.a - 1];
+    vec2_t b = occluder_mesh.projected_vertices[edge.b - 1];
+    vec2_t c_a = occluder_mesh.projected_vertices[
+        third_corner(occluder_mesh.faces[edge.face_a], edge.a, edge.b) - 1];
+    vec2_t c_b = occluder_mesh.projected_vertices[
+        third_corner(occluder_mesh.faces[edge.face_b], edge.a, edge.b) - 1];
+    float side_a = (b.x - a.x) * (c_a.y - a.y) - (b.y - a.y) * (c_a.x - a.x);
+    float side_b = (b.x - a.x) * (c_b.y - a.y) - (b.y - a.y) * (c_b.x - a.x);
+    return (side_a > 0 && side_b < 0) || (side_a < 0 && side_b > 0);
+}
 
-        vec3_t face_vertices[3];
-        face_vertices[0] = mesh.vertices[mesh_face.a - 1];
-        face_vertices[1] = mesh.vertices[mesh_face.b - 1];
-        face_vertices[2] = mesh.vertices[mesh_face.c - 1];
+/**
+ * Rasterize the occluders into the coarse depth pyramid, and keep their
+ * projected triangles for drawing.
+ */
+void update_occluders(void) {
+    array_clear(occluder_triangles);
+    occlusion_begin(window_width, window_height);
 
-        vec3_t transformed_vertices[3];
+    size_t num_vertices = array_length(occluder_mesh.vertices);
+    for (size_t i = 0; i < num_vertices; i++) {
+        vec3_t vertex = occluder_mesh.vertices[i];
+        vertex.z += 5;
+        occluder_mesh.transformed_vertices[i] = vertex;
 
-        // Loop over the vertices and apply transformations
+        vec2_t point = project(vertex);
+        point.x += (window_width / 2);
+        point.y += (window_height / 2);
+        occluder_mesh.projected_vertices[i] = point;
+    }
+
+    size_t num_faces = array_length(occluder_mesh.faces);
+    for (size_t i = 0; i < num_faces; i++) {
+        face_t face = occluder_mesh.faces[i];
+        int corners[3] = {face.a, face.b, face.c};
+
+        triangle_t triangle = {.color = 0xFF555555};
+        float farthest = 0;
+        bool is_in_front = true;
         for (int j = 0; j < 3; j++) {
-            vec3_t transformed_vertex = face_vertices[j];
+            vec3_t vertex = occluder_mesh.transformed_vertices[corners[j] - 1];
+            is_in_front = is_in_front && vertex.z > 0;
 
-            transformed_vertex =
-                vec3_rotate_x(transformed_vertex, mesh.rotation.x);
-            transformed_vertex =
-                vec3_rotate_y(transformed_vertex, mesh.rotation.y);
-            transformed_vertex =
-                vec3_rotate_z(transformed_vertex, mesh.rotation.z);
+            triangle.points[j] =
+                occluder_mesh.projected_vertices[corners[j] - 1];
+            triangle.depths[j] = vertex.z;
+            if (vertex.z > farthest) farthest = vertex.z;
+        }
+        occluder_mesh.face_visible[i] = is_in_front;
+        if (!is_in_front) {
+            continue;
+        }
 
-            // Translate the vertex away from the camera
-            transformed_vertex.z += 5;
+        occlusion_draw_triangle(triangle.points[0], triangle.points[1],
+                                triangle.points[2], farthest);
+        array_push(occluder_triangles, triangle);
+    }
 
-            // Save the transformed_vertex in the array of transformed_vertices
-            transformed_vertices[j] = transformed_vertex;
+    // Faces only cover the cells inside the silhouette together
+    size_t num_edges = array_length(occluder_mesh.edges);
+    for (size_t i = 0; i < num_edges; i++) {
+        edge_t edge = occluder_mesh.edges[i];
+        bool is_drawn = occluder_mesh.face_visible[edge.face_a] ||
+                        (edge.face_b != NO_FACE &&
+                         occluder_mesh.face_visible[edge.face_b]);
+        if (is_drawn && !is_occluder_edge_inside(edge)) {
+            occlusion_draw_edge(occluder_mesh.projected_vertices[edge.a - 1],
+                                occluder_mesh.projected_vertices[edge.b - 1]);
+        }
+    }
+
+    occlusion_build_pyramid();
+}
+
+/**
+ * Test the mesh's bounding box against the occluders. Also finds the depth
+ * of the box center.
+ */
+bool is_mesh_visible(void) {
+    vec3_t bounds[2] = {mesh.bounds_min, mesh.bounds_max};
+    vec3_t center = transform_vertex(
+        vec3_mul(vec3_add(mesh.bounds_min, mesh.bounds_max), 0.5));
+    mesh_center_depth = center.z;
+
+    float min_x = 0, min_y = 0, max_x = 0, max_y = 0, min_depth = 0;
+    for (int i = 0; i < 8; i++) {
+        vec3_t corner = {bounds[i & 1].x, bounds[(i >> 1) & 1].y,
+                         bounds[i >> 2].z};
+        corner = transform_vertex(corner);
+
+        // Part of the box is behind the camera, so it can't be bounded on
+        // the screen. Treat it as visible.
+        if (corner.z <= 0) {
+            return true;
+        }
+
+        vec2_t point = project(corner);
+        point.x += (window_width / 2);
+        point.y += (window_height / 2);
+        if (i == 0 || point.x < min_x) min_x = point.x;
+        if (i == 0 || point.y < min_y) min_y = point.y;
+        if (i == 0 || point.x > max_x) max_x = point.x;
+        if (i == 0 || point.y > max_y) max_y = point.y;
+        if (i == 0 || corner.z < min_depth) min_depth = corner.z;
+    }
+
+    return occlusion_is_visible(min_x, min_y, max_x, max_y, min_depth);
+}
+
+/**
+ * Check whether a face points away from the camera, from its transformed
+ * vertices.
+ */
+bool is_back_face(const vec3_t vertices[3]) {
+    vec3_t vector_a = vertices[0]; /*   A   */
+    vec3_t vector_b = vertices[1]; /*  / \  */
+    vec3_t vector_c = vertices[2]; /* B---C */
+
+    // Get the vector subtraction of A-B and A-C, then normalize them.
+    vec3_t vector_ab = vec3_sub(vector_a, vector_b);
+    vec3_t vector_ac = vec3_sub(vector_a, vector_c);
+    vec3_normalize(&vector_ab);
+    vec3_normalize(&vector_ac);
+
+    // Compute the face normal using the cross product to find the
+    // perpendicular vector. Then normalize it.
+    vec3_t normal = vec3_cross(vector_ab, vector_ac);
+    vec3_normalize(&normal);
+
+    // Find the vector between point a and the camera position
+    vec3_t camera_ray = vec3_sub(camera_position, vector_a);
+
+    // Calculate alignment between camera ray and face normal using dot
+    // product
+    float dot_normal_camera = vec3_dot(normal, camera_ray);
+
+    // Don't render the face if the dot product is less than zero.
+    return dot_normal_camera < 0;
+}
+
+/**
+ * The reference geometry stage: one face at a time on one thread,
+ * transforming each corner of each face.
+ */
+void project_faces_reference(void) {
+    size_t num_faces = array_length(mesh.faces);
+    for (size_t i = 0; i < num_faces; i++) {
+        face_t mesh_face = mesh.faces[i];
+        mesh.face_visible[i] = false;
+
+        int corners[3] = {mesh_face.a, mesh_face.b, mesh_face.c};
+        vec3_t transformed_vertices[3];
+
+        // Loop over the vertices and apply transformations
+        for (int j = 0; j < 3; j++) {
+            transformed_vertices[j] =
+                transform_vertex(mesh_vertex(&mesh, corners[j] - 1));
         }
 
         // Backface culling
-        if (cull_method == CULL_BACKFACE) {
-            vec3_t vector_a = transformed_vertices[0]; /*   A   */
-            vec3_t vector_b = transformed_vertices[1]; /*  / \  */
-            vec3_t vector_c = transformed_vertices[2]; /* B---C */
-
-            // Get the vector subtraction of A-B and A-C, then normalize them.
-            vec3_t vector_ab = vec3_sub(vector_a, vector_b);
-            vec3_t vector_ac = vec3_sub(vector_a, vector_c);
-            vec3_normalize(&vector_ab);
-            vec3_normalize(&vector_ac);
-
-            // Compute the face normal using the cross product to find the
-            // perpendicular vector. Then normalize it.
-            vec3_t normal = vec3_cross(vector_ab, vector_ac);
-            vec3_normalize(&normal);
-
-            // Find the vector between point a and the camera position
-            vec3_t camera_ray = vec3_sub(camera_position, vector_a);
-
-            // Calculate alignment between camera ray and face normal using dot
-            // product
-            float dot_normal_camera = vec3_dot(normal, camera_ray);
-
-            // Don't render the face if the dot product is less than zero.
-            if (dot_normal_camera < 0) {
-                continue;
-            }
+        if (cull_method == CULL_BACKFACE &&
+            is_back_face(transformed_vertices)) {
+            raster_stats.faces_culled++;
+            continue;
         }
 
         vec2_t projected_points[3];
@@ -171,10 +455,20 @@ void update(void) {
             projected_points[j].y += (window_height / 2);
         }
 
+        // Keep the screen position of each corner for the wireframe
+        for (int j = 0; j < 3; j++) {
+            mesh.projected_vertices[corners[j] - 1] = projected_points[j];
+            mesh.vertex_visible[corners[j] - 1] = true;
+        }
+        mesh.face_visible[i] = true;
+
         triangle_t projected_triangle = {
             .points = {{projected_points[0].x, projected_points[0].y},
                        {projected_points[1].x, projected_points[1].y},
                        {projected_points[2].x, projected_points[2].y}},
+            .depths = {transformed_vertices[0].z, transformed_vertices[1].z,
+                       transformed_vertices[2].z},
+            .texcoords = {mesh_face.a_uv, mesh_face.b_uv, mesh_face.c_uv},
             .color = mesh_face.color};
 
         // Save the projected triangle in the array of triangles to render
@@ -182,47 +476,356 @@ void update(void) {
     }
 }
 
-void render(void) {
+/**
+ * Find the range of items (vertices or faces) that belongs to a slice.
+ */
+void slice_range(int slice, size_t num_items, size_t* begin, size_t* end) {
+    *begin = num_items * slice / num_geometry_slices;
+    *end = num_items * (slice + 1) / num_geometry_slices;
+}
+
+/**
+ * Worker task: transform and project one slice of the vertices, each once
+ * no matter how many faces use it.
+ */
+void transform_slice(int slice, void* data) {
+    (void)data;
+    size_t begin, end;
+    slice_range(slice, mesh_vertex_count(&mesh), &begin, &end);
+
+    if (mesh.quantized_vertices != NULL) {
+        kernels.transform_quantized(&mesh.quantized_vertices[begin],
+                                    &mesh.transformed_vertices[begin],
+                                    end - begin, &geometry_matrix);
+    } else {
+        kernels.transform_vertices(&mesh.vertices[begin],
+                                   &mesh.transformed_vertices[begin],
+                                   end - begin, &geometry_transform);
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        vec2_t point = project(mesh.transformed_vertices[i]);
+        point.x += (window_width / 2);
+        point.y += (window_height / 2);
+        mesh.projected_vertices[i] = point;
+    }
+}
+
+/**
+ * Worker task: cull one slice of the faces, writing the visible ones into
+ * the slice's own triangle list in face order.
+ */
+void cull_slice(int slice, void* data) {
+    (void)data;
+    geometry_slice_t* out = &geometry_slices[slice];
+    size_t begin, end;
+    slice_range(slice, array_length(mesh.faces), &begin, &end);
+
+    array_clear(out->triangles);
+    array_reserve(out->triangles, end - begin);
+    out->faces_culled = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        face_t mesh_face = mesh.faces[i];
+        int corners[3] = {mesh_face.a - 1, mesh_face.b - 1, mesh_face.c - 1};
+        vec3_t transformed_vertices[3] = {
+            mesh.transformed_vertices[corners[0]],
+            mesh.transformed_vertices[corners[1]],
+            mesh.transformed_vertices[corners[2]]};
+
+        if (cull_method == CULL_BACKFACE &&
+            is_back_face(transformed_vertices)) {
+            mesh.face_visible[i] = false;
+            out->faces_culled++;
+            continue;
+        }
+        mesh.face_visible[i] = true;
+
+        triangle_t projected_triangle = {
+            .points = {mesh.projected_vertices[corners[0]],
+                       mesh.projected_vertices[corners[1]],
+                       mesh.projected_vertices[corners[2]]},
+            .depths = {transformed_vertices[0].z, transformed_vertices[1].z,
+                       transformed_vertices[2].z},
+            .texcoords = {mesh_face.a_uv, mesh_face.b_uv, mesh_face.c_uv},
+            .color = mesh_face.color};
+        array_push(out->triangles, projected_triangle);
+    }
+}
+
+/**
+ * Worker task: copy one slice's triangles to its place in
+ * triangles_to_render.
+ */
+void copy_slice(int slice, void* data) {
+    (void)data;
+    geometry_slice_t* in = &geometry_slices[slice];
+    memcpy(&triangles_to_render[in->offset], in->triangles,
+           sizeof(triangle_t) * array_length(in->triangles));
+}
+
+/**
+ * The fast geometry stage. The vertices and then the faces are split into
+ * slices that run on the worker pool. A prefix sum over the slices' triangle
+ * counts gives each slice its offset in triangles_to_render, so the final
+ * list is in face order, the same as the reference.
+ */
+void project_faces_parallel(void) {
+    size_t num_faces = array_length(mesh.faces);
+    size_t wanted_slices =
+        (num_faces + geometry_faces_per_slice - 1) / geometry_faces_per_slice;
+    if (wanted_slices < 1) {
+        wanted_slices = 1;
+    }
+    if (wanted_slices > GEOMETRY_MAX_SLICES) {
+        wanted_slices = GEOMETRY_MAX_SLICES;
+    }
+    num_geometry_slices = wanted_slices;
+
+    vec3_t translation = {0, 0, 5};
+    geometry_transform = make_vertex_transform(mesh.rotation, translation);
+    if (mesh.quantized_vertices != NULL) {
+        geometry_matrix = make_quantized_matrix(
+            &geometry_transform, mesh.quantize_scale, mesh.quantize_offset);
+    }
+
+    workers_run(transform_slice, NULL, num_geometry_slices);
+    workers_run(cull_slice, NULL, num_geometry_slices);
+
+    size_t num_triangles = 0;
+    for (int i = 0; i < num_geometry_slices; i++) {
+        geometry_slices[i].offset = num_triangles;
+        num_triangles += array_length(geometry_slices[i].triangles);
+        raster_stats.faces_culled += geometry_slices[i].faces_culled;
+    }
+    array_extend(triangles_to_render, num_triangles);
+    workers_run(copy_slice, NULL, num_geometry_slices);
+
+    // Only the vertex markers need to know which vertices are visible.
+    // Faces in different slices share vertices, so the corners are marked
+    // once the slices are done.
+    if (render_method != RENDER_WIRE_VERTEX) {
+        return;
+    }
+    for (size_t i = 0; i < num_faces; i++) {
+        if (mesh.face_visible[i]) {
+            face_t mesh_face = mesh.faces[i];
+            mesh.vertex_visible[mesh_face.a - 1] = true;
+            mesh.vertex_visible[mesh_face.b - 1] = true;
+            mesh.vertex_visible[mesh_face.c - 1] = true;
+        }
+    }
+}
+
+/**
+ * Transform, cull and project the mesh at its current rotation into
+ * triangles_to_render.
+ */
+void update_geometry(void) {
+    // Empty the array of triangles to render, keeping its memory from the
+    // last frame
+    array_clear(triangles_to_render);
+    array_reserve(triangles_to_render, array_length(mesh.faces));
+
+    // No vertex is visible until a visible face uses it. Only the vertex
+    // markers read this.
+    if (render_method == RENDER_WIRE_VERTEX) {
+        memset(mesh.vertex_visible, 0,
+               sizeof(bool) * mesh_vertex_count(&mesh));
+    }
+
+    // Skip the whole face loop when the mesh is hidden behind occluders.
+    // Without occluders there is no pyramid to build or test against.
+    if (array_length(occluder_mesh.faces) > 0) {
+        update_occluders();
+        if (!is_mesh_visible() && is_occlusion_culling) {
+            memset(mesh.face_visible, 0,
+                   sizeof(bool) * array_length(mesh.faces));
+            raster_stats.faces_occluded = array_length(mesh.faces);
+            return;
+        }
+    }
+
+    raster_stats.faces_in = array_length(mesh.faces);
+    if (is_reference_path) {
+        project_faces_reference();
+    } else {
+        project_faces_parallel();
+    }
+}
+
+void update(void) {
+    // This locks the execution to match the desired FPS.
+    int time_to_wait =
+        FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
+
+    if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
+        SDL_Delay(time_to_wait);
+    }
+
+    previous_frame_time = SDL_GetTicks();
+
+    stats_begin_frame(is_printing_stats || render_method == RENDER_OVERDRAW,
+                      window_width * window_height);
+
+    if (is_rotating) {
+        mesh.rotation.x += 0.01;
+        mesh.rotation.y += 0.005;
+        mesh.rotation.z += 0.0001;
+    }
+
+    update_geometry();
+}
+
+/**
+ * Draw the wireframe from the mesh's unique edges and vertices.
+ *
+ * An edge is drawn once if either of its faces survived culling, and a
+ * vertex marker is drawn once if any visible face uses the vertex.
+ */
+void render_wireframe(void) {
+    size_t num_edges = array_length(mesh.edges);
+    for (size_t i = 0; i < num_edges; i++) {
+        edge_t edge = mesh.edges[i];
+        bool is_visible =
+            mesh.face_visible[edge.face_a] ||
+            (edge.face_b != NO_FACE && mesh.face_visible[edge.face_b]);
+        if (!is_visible) {
+            continue;
+        }
+
+        vec2_t a = mesh.projected_vertices[edge.a - 1];
+        vec2_t b = mesh.projected_vertices[edge.b - 1];
+        draw_line(a.x, a.y, b.x, b.y, 0xFFFFFFFF);
+    }
+
+    if (render_method == RENDER_WIRE_VERTEX) {
+        uint32_t point_color = 0xFFFFB000;  // amber
+        size_t num_wire_vertices = array_length(mesh.wire_vertices);
+        for (size_t i = 0; i < num_wire_vertices; i++) {
+            int index = mesh.wire_vertices[i] - 1;
+            if (mesh.vertex_visible[index]) {
+                vec2_t point = mesh.projected_vertices[index];
+                draw_rect(point.x - 3, point.y - 3, 6, 6, point_color);
+            }
+        }
+    }
+}
+
+/**
+ * Draw the occluder triangles on one side of the mesh. Without a depth
+ * buffer, occluders are ordered against the mesh as a whole: the ones
+ * behind its center go first and the rest go over it.
+ */
+void render_occluders(bool is_behind_mesh) {
+    // The raster counters are for the mesh alone
+    is_counting_raster = false;
+
+    size_t num_triangles = array_length(occluder_triangles);
+    for (size_t i = 0; i < num_triangles; i++) {
+        triangle_t triangle = occluder_triangles[i];
+        float depth =
+            (triangle.depths[0] + triangle.depths[1] + triangle.depths[2]) / 3;
+        if ((depth > mesh_center_depth) != is_behind_mesh) {
+            continue;
+        }
+
+        draw_filled_triangle(triangle.points[0].x, triangle.points[0].y,
+                             triangle.points[1].x, triangle.points[1].y,
+                             triangle.points[2].x, triangle.points[2].y,
+                             triangle.color);
+    }
+
+    is_counting_raster = true;
+}
+
+/**
+ * Draw the wireframe one triangle at a time, the way it was drawn before the
+ * shared edge lists. Shared edges are drawn twice, so this is slower but
+ * simple enough to trust. The vertex markers go on top of all the lines,
+ * as in render_wireframe().
+ */
+void render_reference_wireframe(void) {
+    size_t num_triangles = array_length(triangles_to_render);
+    for (size_t i = 0; i < num_triangles; i++) {
+        triangle_t triangle = triangles_to_render[i];
+        draw_triangle(triangle.points[0].x, triangle.points[0].y,
+                      triangle.points[1].x, triangle.points[1].y,
+                      triangle.points[2].x, triangle.points[2].y, 0xFFFFFFFF);
+    }
+
+    if (render_method == RENDER_WIRE_VERTEX) {
+        for (size_t i = 0; i < num_triangles; i++) {
+            triangle_t triangle = triangles_to_render[i];
+            for (int j = 0; j < 3; j++) {
+                draw_rect(triangle.points[j].x - 3, triangle.points[j].y - 3,
+                          6, 6, 0xFFFFB000);
+            }
+        }
+    }
+}
+
+/**
+ * Draw everything for the current frame into the color buffer.
+ */
+void draw_frame(void) {
     draw_grid(10);
 
     // draw_filled_triangle(300, 100, 50, 400, 500, 700, 0xFF00FF00);
 
-    int num_triangles = array_length(triangles_to_render);
-    for (int i = 0; i < num_triangles; i++) {
+    render_occluders(true);
+
+    size_t num_triangles = array_length(triangles_to_render);
+    for (size_t i = 0; i < num_triangles; i++) {
         triangle_t triangle = triangles_to_render[i];
 
         if (render_method == RENDER_FILL_TRIANGLE ||
-            render_method == RENDER_FILL_TRIANGLE_WIRE) {
+            render_method == RENDER_FILL_TRIANGLE_WIRE ||
+            render_method == RENDER_OVERDRAW) {
             draw_filled_triangle(triangle.points[0].x, triangle.points[0].y,
                                  triangle.points[1].x, triangle.points[1].y,
                                  triangle.points[2].x, triangle.points[2].y,
                                  triangle.color);
         }
 
-        if (render_method == RENDER_WIRE ||
-            render_method == RENDER_WIRE_VERTEX ||
-            render_method == RENDER_FILL_TRIANGLE_WIRE) {
-            draw_triangle(triangle.points[0].x, triangle.points[0].y,
-                          triangle.points[1].x, triangle.points[1].y,
-                          triangle.points[2].x, triangle.points[2].y,
-                          0xFFFFFFFF);
+        if (render_method == RENDER_TEXTURED ||
+            render_method == RENDER_TEXTURED_WIRE) {
+            draw_textured_triangle(&triangle, mesh.texture);
         }
+    }
 
-        uint32_t point_color = 0xFFFFB000;  // amber
-        if (render_method == RENDER_WIRE_VERTEX) {
-            draw_rect(triangle.points[0].x - 3, triangle.points[0].y - 3, 6, 6,
-                      point_color);
-            draw_rect(triangle.points[1].x - 3, triangle.points[1].y - 3, 6, 6,
-                      point_color);
-            draw_rect(triangle.points[2].x - 3, triangle.points[2].y - 3, 6, 6,
-                      point_color);
+    if (render_method == RENDER_WIRE || render_method == RENDER_WIRE_VERTEX ||
+        render_method == RENDER_FILL_TRIANGLE_WIRE ||
+        render_method == RENDER_TEXTURED_WIRE) {
+        if (is_reference_path) {
+            render_reference_wireframe();
+        } else {
+            render_wireframe();
         }
     }
 
-    // Clear the array of triangles to render every frame loop
-    array_free(triangles_to_render);
+    render_occluders(false);
+
+    if (render_method == RENDER_OVERDRAW) {
+        draw_overdraw_heatmap(color_buffer, window_width * window_height);
+    }
+}
+
+void render(void) {
+    draw_frame();
+
+    if (is_printing_stats) {
+        stats_print_frame();
+    }
 
     render_color_buffer();
+    capture_frame(color_buffer);
+
+    // Hand the finished frame to the readers and draw the next one in a
+    // different slot
+    if (shm_output_is_running()) {
+        color_buffer = shm_output_publish_frame();
+    }
     clear_color_buffer(0xFF000000);
 
     SDL_RenderPresent(renderer);
@@ -230,25 +833,443 @@ void render(void) {
 
 // Free the memory
 void free_resources(void) {
-    free(color_buffer);
-    array_free(mesh.faces);
-    array_free(mesh.vertices);
+    if (shm_output_is_running()) {
+        shm_output_stop();
+    } else {
+        free(color_buffer);
+    }
+    array_free(triangles_to_render);
+    array_free(occluder_triangles);
+    for (int i = 0; i < GEOMETRY_MAX_SLICES; i++) {
+        array_free(geometry_slices[i].triangles);
+        geometry_slices[i].triangles = NULL;
+    }
+    free_mesh(&mesh);
+    free_mesh(&occluder_mesh);
+    occlusion_free();
+    stats_free();
+}
+
+/**
+ * Render one frame of the current mesh offscreen. The reference path also
+ * uses the baseline kernels.
+ */
+void render_offscreen(bool is_reference) {
+    kernel_level_t level = kernels_level();
+    if (is_reference) {
+        kernels_select(KERNEL_BASELINE);
+    }
+    is_reference_path = is_reference;
+
+    stats_begin_frame(false, window_width * window_height);
+    clear_color_buffer(0xFF000000);
+    update_geometry();
+    draw_frame();
+
+    is_reference_path = false;
+    kernels_select(level);
+}
+
+/**
+ * Compare a rendered frame against another image and print the result.
+ * Returns true when at most max_diff_pixels pixels differ.
+ */
+bool verify_frame(const char* name, const char* against,
+                  const uint32_t* actual, const uint32_t* expected,
+                  int max_diff_pixels) {
+    image_diff_t diff =
+        diff_images(expected, actual, window_width * window_height);
+    bool is_ok = diff.differing_pixels <= max_diff_pixels;
+    printf("%-32s vs %-9s %6d pixels differ (max %3d), max channel diff "
+           "%3d  %s\n",
+           name, against, diff.differing_pixels, max_diff_pixels,
+           diff.max_channel_diff, is_ok ? "ok" : "FAIL");
+    return is_ok;
+}
+
+/**
+ * Convert a color as the Y4M capture does and compare it against the
+ * expected Y, Cb and Cr. Prints the result and returns true when they match.
+ */
+bool verify_ycbcr(const char* name, uint32_t color, const uint8_t expected[3]) {
+    uint8_t actual[3];
+    capture_rgb_to_ycbcr(color, actual);
+    bool is_ok = memcmp(actual, expected, sizeof(actual)) == 0;
+    printf("%-32s Y %3d Cb %3d Cr %3d, expected %3d %3d %3d  %s\n", name,
+           actual[0], actual[1], actual[2], expected[0], expected[1],
+           expected[2], is_ok ? "ok" : "FAIL");
+    return is_ok;
 }
 
-int main(void) {
+/**
+ * Build the wireframe of three triangles that share one edge, a non-manifold
+ * mesh, and check that the shared edge is listed once. Prints the result
+ * and returns true when it is.
+ */
+bool verify_shared_edge(void) {
+    mesh_t fan = {0};
+    vec3_t vertex = {0, 0, 0};
+    for (int i = 0; i < 5; i++) {
+        array_push(fan.vertices, vertex);
+    }
+    face_t faces[] = {{.a = 1, .b = 2, .c = 3},
+                      {.a = 2, .b = 1, .c = 4},
+                      {.a = 1, .b = 2, .c = 5}};
+    for (int i = 0; i < 3; i++) {
+        array_push(fan.faces, faces[i]);
+    }
+    build_mesh_wireframe(&fan);
+
+    int num_shared = 0;
+    size_t num_edges = array_length(fan.edges);
+    for (size_t i = 0; i < num_edges; i++) {
+        if (fan.edges[i].a == 1 && fan.edges[i].b == 2) {
+            num_shared++;
+        }
+    }
+    // The shared edge, and two more for each triangle
+    bool is_ok = num_shared == 1 && num_edges == 7;
+    printf("%-32s %zu edges, shared edge listed %d times  %s\n",
+           "wireframe_non_manifold", num_edges, num_shared,
+           is_ok ? "ok" : "FAIL");
+
+    free_mesh(&fan);
+    return is_ok;
+}
+
+/**
+ * Render fixed poses of the test meshes without a window and check the
+ * fast paths (threaded geometry and SIMD kernels) against the reference
+ * path, at every supported kernel level (or only the selected one when
+ * is_one_level).
+ *
+ * The first level must draw the same pixels as the reference, and every
+ * other level the same pixels as the first. With a golden directory, the
+ * reference frame must also match the stored PPM image, or is saved as it
+ * when is_writing. All of these are exact, except that with is_quantizing
+ * the frames may differ by the render method's tolerance: goldens come
+ * from float vertices, and the reference decodes each vertex while the
+ * fast path folds the decoding into the transform.
+ *
+ * The Y4M capture's color conversion is checked first, at the saturated
+ * colors where its fixed point chroma is closest to overflowing, and then
+ * the wireframe of a non-manifold edge.
+ *
+ * Returns the process exit status: 0 when every check passed.
+ */
+int run_verify(const char* golden_dir, bool is_writing, bool is_one_level) {
+    static const char* mesh_names[] = {"cube", "f22"};
+    static const vec3_t poses[] = {
+        {0, 0, 0}, {0.5, 0.8, 0.1}, {2.0, 4.0, 1.0}};
+    // Tolerances for quantized vertices, as fractions of the frame's pixels
+    static const struct {
+        enum render_method method;
+        const char* name;
+        float max_diff_fraction;
+    } methods[] = {{RENDER_WIRE_VERTEX, "wire", 0.0002},
+                   {RENDER_FILL_TRIANGLE_WIRE, "fill", 0.0001},
+                   {RENDER_TEXTURED, "textured", 0.0001}};
+    static const struct {
+        const char* name;
+        uint32_t color;
+        uint8_t ycbcr[3];
+    } colors[] = {{"y4m_black", 0xFF000000, {0, 128, 128}},
+                  {"y4m_white", 0xFFFFFFFF, {255, 128, 128}},
+                  {"y4m_red", 0xFFFF0000, {76, 85, 255}},
+                  {"y4m_blue", 0xFF0000FF, {29, 255, 107}}};
+    int num_meshes = sizeof(mesh_names) / sizeof(mesh_names[0]);
+    int num_poses = sizeof(poses) / sizeof(poses[0]);
+    int num_methods = sizeof(methods) / sizeof(methods[0]);
+    int num_colors = sizeof(colors) / sizeof(colors[0]);
+
+    // Small slices, so the test meshes are spread over several workers
+    geometry_faces_per_slice = 16;
+
+    kernel_level_t selected_level = kernels_level();
+    kernel_level_t first_level =
+        is_one_level ? selected_level : KERNEL_BASELINE;
+
+    window_width = VERIFY_WIDTH;
+    window_height = VERIFY_HEIGHT;
+    int num_pixels = window_width * window_height;
+    color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * num_pixels);
+    uint32_t* reference = (uint32_t*)malloc(sizeof(uint32_t) * num_pixels);
+    uint32_t* first_fast = (uint32_t*)malloc(sizeof(uint32_t) * num_pixels);
+    texture_t* texture = create_checker_texture(256, 0xFFF1C232, 0xFF000F89);
+    cull_method = CULL_BACKFACE;
+
+    int num_checks = 0;
+    int num_failed = 0;
+    char path[1024];
+
+    for (int i = 0; i < num_colors; i++) {
+        num_checks++;
+        if (!verify_ycbcr(colors[i].name, colors[i].color, colors[i].ycbcr)) {
+            num_failed++;
+        }
+    }
+
+    num_checks++;
+    if (!verify_shared_edge()) {
+        num_failed++;
+    }
+
+    for (int i = 0; i < num_meshes; i++) {
+        snprintf(path, sizeof(path), "./assets/%s.obj", mesh_names[i]);
+        if (!load_obj_file_data(&mesh, path)) {
+            num_checks++;
+            num_failed++;
+            continue;
+        }
+        build_mesh_wireframe(&mesh);
+        compute_mesh_bounds(&mesh);
+        if (is_quantizing) {
+            quantize_mesh_vertices(&mesh);
+        }
+        mesh.texture = texture;
+
+        for (int j = 0; j < num_poses; j++) {
+            for (int k = 0; k < num_methods; k++) {
+                char name[64];
+                snprintf(name, sizeof(name), "%s_pose%d_%s", mesh_names[i], j,
+                         methods[k].name);
+                mesh.rotation = poses[j];
+                render_method = methods[k].method;
+
+                render_offscreen(true);
+                memcpy(reference, color_buffer, sizeof(uint32_t) * num_pixels);
+                int max_diff_pixels =
+                    is_quantizing ? num_pixels * methods[k].max_diff_fraction
+                                  : 0;
+
+                if (golden_dir != NULL) {
+                    snprintf(path, sizeof(path), "%s/%s.ppm", golden_dir, name);
+                    bool is_ok;
+                    if (is_writing) {
+                        is_ok = save_ppm_image(path, reference, window_width,
+                                               window_height);
+                    } else {
+                        int golden_width;
+                        int golden_height;
+                        uint32_t* golden =
+                            load_ppm_image(path, &golden_width, &golden_height);
+                        is_ok = golden != NULL &&
+                                golden_width == window_width &&
+                                golden_height == window_height;
+                        if (is_ok) {
+                            is_ok = verify_frame(name, "golden", reference,
+                                                 golden, max_diff_pixels);
+                        } else {
+                            printf("%-32s golden missing or wrong size\n",
+                                   name);
+                        }
+                        free(golden);
+                    }
+                    num_checks++;
+                    if (!is_ok) {
+                        num_failed++;
+                    }
+                }
+
+                bool is_first_level = true;
+                char first_level_name[32] = "";
+                for (kernel_level_t level = first_level;
+                     level <= selected_level; level++) {
+                    if (!kernels_is_supported(level)) {
+                        continue;
+                    }
+                    char level_name[96];
+                    snprintf(level_name, sizeof(level_name), "%s [%s]", name,
+                             kernel_level_name(level));
+
+                    kernels_select(level);
+                    render_offscreen(false);
+
+                    bool is_ok;
+                    if (is_first_level) {
+                        is_ok = verify_frame(level_name, "reference",
+                                             color_buffer, reference,
+                                             max_diff_pixels);
+                        memcpy(first_fast, color_buffer,
+                               sizeof(uint32_t) * num_pixels);
+                        snprintf(first_level_name, sizeof(first_level_name),
+                                 "%s", kernel_level_name(level));
+                        is_first_level = false;
+                    } else {
+                        is_ok = verify_frame(level_name, first_level_name,
+                                             color_buffer, first_fast, 0);
+                    }
+                    num_checks++;
+                    if (!is_ok) {
+                        num_failed++;
+                    }
+                }
+                kernels_select(selected_level);
+            }
+        }
+
+        // The texture is shared between the meshes
+        mesh.texture = NULL;
+        free_mesh(&mesh);
+        memset(&mesh, 0, sizeof(mesh));
+    }
+
+    printf("verify: %d of %d checks passed\n", num_checks - num_failed,
+           num_checks);
+
+    free(first_fast);
+    free(reference);
+    free_texture(texture);
+    return num_failed > 0 ? 1 : 0;
+}
+
+void print_usage(char* program) {
+    printf("usage: %s [--mesh PATH] [--texture PATH] [--occluder PATH]\n"
+           "          [--on-demand] [--stats]\n"
+           "          [--capture PATH [--capture-lossless]]\n"
+           "          [--kernels LEVEL] [--threads N] [--quantize]\n"
+           "          [--shm NAME [--shm-frames N]]\n"
+           "       %s --verify [--quantize]\n"
+           "          [--golden DIR | --write-golden DIR]\n",
+           program, program);
+    printf("  --mesh PATH     load an obj file in the background and reload\n");
+    printf("                  it when it changes\n");
+    printf("  --texture PATH  texture the mesh with a binary PPM file instead\n");
+    printf("                  of a checkerboard\n");
+    printf("  --occluder PATH load an obj file of static occluders that hide\n");
+    printf("                  the mesh when it is behind them\n");
+    printf("  --on-demand     only redraw when something changes; press p\n");
+    printf("                  to pause the rotation and let the scene idle\n");
+    printf("  --stats         print face and pixel counters for every frame\n");
+    printf("  --capture PATH  write every frame to PATH in the background:\n");
+    printf("                  *.y4m or *.raw for one stream, otherwise a PPM\n");
+    printf("                  sequence like frames/frame_%%05d.ppm\n");
+    printf("  --capture-lossless\n");
+    printf("                  wait for the disk instead of dropping frames\n");
+    printf("                  when the writer falls behind\n");
+    printf("  --shm NAME      draw the frames into a POSIX shared memory ring\n");
+    printf("                  like /3drenderer for other processes to read\n");
+    printf("  --shm-frames N  number of frames in the ring (default %d)\n",
+           SHM_OUTPUT_DEFAULT_FRAMES);
+    printf("  --kernels LEVEL use the baseline, sse4.1, avx2 or avx512\n");
+    printf("                  kernels instead of the best this CPU supports\n");
+    printf("  --threads N     run the geometry stage on N threads (default:\n");
+    printf("                  one per CPU core)\n");
+    printf("  --quantize      store vertices as 16-bit steps across the\n");
+    printf("                  mesh's bounding box, half the memory\n");
+    printf("  --verify        render test poses of the cube and the f22\n");
+    printf("                  without a window and check that the fast\n");
+    printf("                  paths match the reference path, at every\n");
+    printf("                  kernel level or only the one from --kernels\n");
+    printf("  --golden DIR    also compare each frame to DIR/<name>.ppm\n");
+    printf("  --write-golden DIR\n");
+    printf("                  save the reference frames to DIR as goldens\n");
+}
+
+int main(int argc, char* argv[]) {
+    char* capture_path = NULL;
+    bool is_capture_lossless = false;
+    bool is_verifying = false;
+    char* golden_dir = NULL;
+    bool is_writing_golden = false;
+    kernel_level_t kernel_level = kernels_best_level();
+    bool is_kernel_forced = false;
+    int num_threads = SDL_GetCPUCount();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            mesh_filename = argv[++i];
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            texture_filename = argv[++i];
+        } else if (strcmp(argv[i], "--occluder") == 0 && i + 1 < argc) {
+            occluder_filename = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            is_printing_stats = true;
+        } else if (strcmp(argv[i], "--on-demand") == 0) {
+            is_on_demand = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--capture-lossless") == 0) {
+            is_capture_lossless = true;
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--shm-frames") == 0 && i + 1 < argc) {
+            shm_num_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc &&
+                   kernel_level_from_name(argv[i + 1], &kernel_level)) {
+            is_kernel_forced = true;
+            i++;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quantize") == 0) {
+            is_quantizing = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            is_verifying = true;
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_dir = argv[++i];
+        } else if (strcmp(argv[i], "--write-golden") == 0 && i + 1 < argc) {
+            golden_dir = argv[++i];
+            is_writing_golden = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Pick the kernels once, before anything draws
+    kernels_select(kernel_level);
+    if (kernels_level() != kernel_level) {
+        printf("%s kernels are not supported here, using %s\n",
+               kernel_level_name(kernel_level),
+               kernel_level_name(kernels_level()));
+    }
+
+    workers_start(num_threads);
+
+    if (is_verifying) {
+        int status =
+            run_verify(golden_dir, is_writing_golden, is_kernel_forced);
+        workers_stop();
+        free_resources();
+        return status;
+    }
+
     /* Create an SDL window */
     is_running = initialize_window();
 
-    setup();
+    int status = 0;
+    if (!setup()) {
+        is_running = false;
+        status = 1;
+    }
+
+    if (is_running && capture_path != NULL &&
+        !capture_start(capture_path, window_width, window_height, FPS,
+                       is_capture_lossless)) {
+        is_running = false;
+        status = 1;
+    }
 
     while (is_running) {
         process_input();
+        swap_loaded_mesh();
+
+        if (is_on_demand && !is_scene_dirty && !is_rotating) {
+            continue;
+        }
+
         update();
         render();
+        is_scene_dirty = false;
     }
 
+    if (!capture_stop()) {
+        status = 1;
+    }
+    loader_stop();
+    workers_stop();
     destroy_window();
     free_resources();
 
-    return 0;
+    return status;
 }
@@ -1,9 +1,31 @@
 #include "mesh.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "array.h"
 
-mesh_t mesh = {.vertices = NULL, .faces = NULL, .rotation = {0, 0, 0}};
+// Marks an empty slot in the edge hash table
+#define NO_EDGE ((size_t)-1)
+
+mesh_t mesh = {.vertices = NULL,
+               .faces = NULL,
+               .texcoords = NULL,
+               .texture = NULL,
+               .rotation = {0, 0, 0},
+               .bounds_min = {0, 0, 0},
+               .bounds_max = {0, 0, 0},
+               .quantized_vertices = NULL,
+               .quantize_scale = {0, 0, 0},
+               .quantize_offset = {0, 0, 0},
+               .edges = NULL,
+               .wire_vertices = NULL,
+               .face_visible = NULL,
+               .vertex_visible = NULL,
+               .transformed_vertices = NULL,
+               .projected_vertices = NULL};
 
 vec3_t cube_vertices[N_CUBE_VERTICES] = {
     {.x = -1, .y = -1, .z = -1},  // 1
@@ -19,43 +41,123 @@ vec3_t cube_vertices[N_CUBE_VERTICES] = {
 // Clockwise order faces out.
 face_t cube_faces[N_CUBE_FACES] = {
     // front
-    {.a = 1, .b = 2, .c = 3, .color = 0xFFFF0000},
-    {.a = 1, .b = 3, .c = 4, .color = 0xFFFF0000},
+    {.a = 1,
+     .b = 2,
+     .c = 3,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFFFF0000},
+    {.a = 1,
+     .b = 3,
+     .c = 4,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFFFF0000},
     // right
-    {.a = 4, .b = 3, .c = 5, .color = 0xFF00FF00},
-    {.a = 4, .b = 5, .c = 6, .color = 0xFF00FF00},
+    {.a = 4,
+     .b = 3,
+     .c = 5,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFF00FF00},
+    {.a = 4,
+     .b = 5,
+     .c = 6,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFF00FF00},
     // back
-    {.a = 6, .b = 5, .c = 7, .color = 0xFF0000FF},
-    {.a = 6, .b = 7, .c = 8, .color = 0xFF0000FF},
+    {.a = 6,
+     .b = 5,
+     .c = 7,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFF0000FF},
+    {.a = 6,
+     .b = 7,
+     .c = 8,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFF0000FF},
     // left
-    {.a = 8, .b = 7, .c = 2, .color = 0xFFFFFF00},
-    {.a = 8, .b = 2, .c = 1, .color = 0xFFFFFF00},
+    {.a = 8,
+     .b = 7,
+     .c = 2,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFFFFFF00},
+    {.a = 8,
+     .b = 2,
+     .c = 1,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFFFFFF00},
     // top
-    {.a = 2, .b = 7, .c = 5, .color = 0xFFFF00FF},
-    {.a = 2, .b = 5, .c = 3, .color = 0xFFFF00FF},
+    {.a = 2,
+     .b = 7,
+     .c = 5,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFFFF00FF},
+    {.a = 2,
+     .b = 5,
+     .c = 3,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFFFF00FF},
     // bottom
-    {.a = 6, .b = 8, .c = 1, .color = 0xFF00FFFF},
-    {.a = 6, .b = 1, .c = 4, .color = 0xFF00FFFF}};
+    {.a = 6,
+     .b = 8,
+     .c = 1,
+     .a_uv = {0, 1},
+     .b_uv = {0, 0},
+     .c_uv = {1, 0},
+     .color = 0xFF00FFFF},
+    {.a = 6,
+     .b = 1,
+     .c = 4,
+     .a_uv = {0, 1},
+     .b_uv = {1, 0},
+     .c_uv = {1, 1},
+     .color = 0xFF00FFFF}};
 
 /**
- * Push the cube vertices and cube faces into the cube mesh.
+ * Push the cube vertices and cube faces into the target mesh.
  */
-void load_cube_mesh_data(void) {
-    for (int i = 0; i < N_CUBE_VERTICES; i++) {
-        vec3_t cube_vertex = cube_vertices[i];
-        array_push(mesh.vertices, cube_vertex);
-    }
+void load_cube_mesh_data(mesh_t* target) {
+    array_append_n(target->vertices, cube_vertices, N_CUBE_VERTICES);
+    array_append_n(target->faces, cube_faces, N_CUBE_FACES);
+}
 
-    for (int i = 0; i < N_CUBE_FACES; i++) {
-        face_t cube_face = cube_faces[i];
-        array_push(mesh.faces, cube_face);
+/**
+ * Get the texture coordinate for a 1-based obj index, or (0,0) if the index
+ * is missing.
+ */
+static tex2_t lookup_texcoord(mesh_t* target, int index) {
+    tex2_t texcoord = {0, 0};
+    if (index > 0 && (size_t)index <= array_length(target->texcoords)) {
+        texcoord = target->texcoords[index - 1];
     }
+    return texcoord;
 }
 
 /**
- * Load mesh data from an obj file.
+ * Load mesh data from an obj file into the target mesh.
+ *
+ * Returns false if the file can't be opened. Faces that point at missing
+ * vertices are dropped, so a half-written file can't crash the renderer.
  */
-void load_obj_file_data(char* filename) {
+bool load_obj_file_data(mesh_t* target, const char* filename) {
     FILE* file;
     int max_char = 1024;
     char line[max_char];
@@ -63,7 +165,8 @@ void load_obj_file_data(char* filename) {
     file = fopen(filename, "r");
 
     if (file == NULL) {
-        printf("file not found: %s", filename);
+        printf("file not found: %s\n", filename);
+        return false;
     }
 
     while (fgets(line, max_char, file)) {
@@ -71,13 +174,22 @@ void load_obj_file_data(char* filename) {
         if (strncmp(line, "v ", 2) == 0) {
             vec3_t vertex;
             sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+            array_push(target->vertices, vertex);
+        }
+
+        // Look for texture coordinate information. OBJ puts v = 0 at the
+        // bottom, so flip it to match the texture rows.
+        if (strncmp(line, "vt ", 3) == 0) {
+            tex2_t texcoord;
+            sscanf(line, "vt %f %f", &texcoord.u, &texcoord.v);
+            texcoord.v = 1.0 - texcoord.v;
+            array_push(target->texcoords, texcoord);
         }
 
         // Look for face information
         if (strncmp(line, "f ", 2) == 0) {
             int vertex_indices[3];
-            int texture_indices[3];
+            int texture_indices[3] = {0, 0, 0};
             int normal_indices[3];
 
             sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", &vertex_indices[0],
@@ -87,9 +199,262 @@ void load_obj_file_data(char* filename) {
 
             face_t face = {.a = vertex_indices[0],
                            .b = vertex_indices[1],
-                           .c = vertex_indices[2]};
+                           .c = vertex_indices[2],
+                           .a_uv = lookup_texcoord(target, texture_indices[0]),
+                           .b_uv = lookup_texcoord(target, texture_indices[1]),
+                           .c_uv = lookup_texcoord(target, texture_indices[2])};
+
+            array_push(target->faces, face);
+        }
+    }
+
+    fclose(file);
+
+    size_t num_vertices = array_length(target->vertices);
+    size_t num_faces = array_length(target->faces);
+    face_t* valid_faces = NULL;
+    array_reserve(valid_faces, num_faces);
+    for (size_t i = 0; i < num_faces; i++) {
+        face_t face = target->faces[i];
+        if (face.a >= 1 && (size_t)face.a <= num_vertices && face.b >= 1 &&
+            (size_t)face.b <= num_vertices && face.c >= 1 &&
+            (size_t)face.c <= num_vertices) {
+            array_push(valid_faces, face);
+        }
+    }
+    if (array_length(valid_faces) < num_faces) {
+        printf("dropped %zu faces with bad vertex indices: %s\n",
+               num_faces - array_length(valid_faces), filename);
+    }
+    array_free(target->faces);
+    target->faces = valid_faces;
+
+    // The arrays grew by doubling; give back the slack
+    array_shrink(target->vertices);
+    array_shrink(target->texcoords);
+    array_shrink(target->faces);
+
+    return true;
+}
 
-            array_push(mesh.faces, face);
+/**
+ * Find or add the edge between vertices a and b, using an open addressing
+ * hash table of edge indices (NO_EDGE marks an empty slot).
+ */
+static void add_edge(mesh_t* target, size_t* slots, size_t slot_mask, int a,
+                     int b, size_t face) {
+    int lo = a < b ? a : b;
+    int hi = a < b ? b : a;
+    size_t hash = ((size_t)lo * 2654435761u) ^ ((size_t)hi * 40503u);
+    size_t slot = hash & slot_mask;
+
+    while (slots[slot] != NO_EDGE) {
+        edge_t* edge = &target->edges[slots[slot]];
+        if (edge->a == lo && edge->b == hi) {
+            // An edge with more than two faces is still listed once, so
+            // it's drawn once. Its first two faces decide if it's drawn.
+            if (edge->face_b == NO_FACE) {
+                edge->face_b = face;
+            }
+            return;
+        }
+        slot = (slot + 1) & slot_mask;
+    }
+
+    edge_t edge = {.a = lo, .b = hi, .face_a = face, .face_b = NO_FACE};
+    array_push(target->edges, edge);
+    slots[slot] = array_length(target->edges) - 1;
+}
+
+/**
+ * Build the list of unique edges and unique vertices from the faces, and
+ * allocate the per-frame vertex and visibility arrays.
+ *
+ * The wireframe render methods draw from these lists, so a shared edge is
+ * drawn once instead of once per face, and each vertex marker is drawn once
+ * no matter how many faces use it.
+ */
+void build_mesh_wireframe(mesh_t* target) {
+    size_t num_faces = array_length(target->faces);
+    size_t num_vertices = array_length(target->vertices);
+
+    // A closed mesh has 3/2 edges per face
+    array_reserve(target->edges, num_faces * 3 / 2);
+    array_reserve(target->wire_vertices, num_vertices);
+
+    // Keep the hash table at most half full
+    size_t num_slots = 1;
+    while (num_slots < num_faces * 3 * 2) {
+        num_slots *= 2;
+    }
+    size_t* slots = (size_t*)malloc(sizeof(size_t) * num_slots);
+    for (size_t i = 0; i < num_slots; i++) {
+        slots[i] = NO_EDGE;
+    }
+
+    bool* used = (bool*)calloc(num_vertices + 1, sizeof(bool));
+
+    for (size_t i = 0; i < num_faces; i++) {
+        face_t face = target->faces[i];
+        add_edge(target, slots, num_slots - 1, face.a, face.b, i);
+        add_edge(target, slots, num_slots - 1, face.b, face.c, i);
+        add_edge(target, slots, num_slots - 1, face.c, face.a, i);
+
+        int corners[3] = {face.a, face.b, face.c};
+        for (int j = 0; j < 3; j++) {
+            if (corners[j] >= 1 && (size_t)corners[j] <= num_vertices &&
+                !used[corners[j]]) {
+                used[corners[j]] = true;
+                array_push(target->wire_vertices, corners[j]);
+            }
         }
     }
+
+    free(slots);
+    free(used);
+
+    target->face_visible = (bool*)calloc(num_faces, sizeof(bool));
+    target->vertex_visible = (bool*)calloc(num_vertices, sizeof(bool));
+    target->transformed_vertices =
+        (vec3_t*)calloc(num_vertices, sizeof(vec3_t));
+    target->projected_vertices = (vec2_t*)calloc(num_vertices, sizeof(vec2_t));
+}
+
+/**
+ * Find the axis-aligned bounding box of the mesh's vertices.
+ */
+void compute_mesh_bounds(mesh_t* target) {
+    size_t num_vertices = array_length(target->vertices);
+    vec3_t bounds_min = {0, 0, 0};
+    vec3_t bounds_max = {0, 0, 0};
+
+    for (size_t i = 0; i < num_vertices; i++) {
+        vec3_t vertex = target->vertices[i];
+        if (i == 0) {
+            bounds_min = vertex;
+            bounds_max = vertex;
+            continue;
+        }
+        if (vertex.x < bounds_min.x) bounds_min.x = vertex.x;
+        if (vertex.y < bounds_min.y) bounds_min.y = vertex.y;
+        if (vertex.z < bounds_min.z) bounds_min.z = vertex.z;
+        if (vertex.x > bounds_max.x) bounds_max.x = vertex.x;
+        if (vertex.y > bounds_max.y) bounds_max.y = vertex.y;
+        if (vertex.z > bounds_max.z) bounds_max.z = vertex.z;
+    }
+
+    target->bounds_min = bounds_min;
+    target->bounds_max = bounds_max;
+}
+
+/**
+ * Find the quantization step for one axis of the bounding box. A flat axis
+ * gets a step of 0, so every vertex decodes to its one value.
+ */
+static float quantize_step(float min, float max) {
+    return (max - min) / QUANTIZE_STEPS;
+}
+
+static uint16_t quantize_value(float value, float min, float step) {
+    if (step == 0) {
+        return 0;
+    }
+    float steps = floorf((value - min) / step + 0.5f);
+    if (steps < 0) steps = 0;
+    if (steps > QUANTIZE_STEPS) steps = QUANTIZE_STEPS;
+    return (uint16_t)steps;
+}
+
+/**
+ * Replace the float vertices with 16-bit positions across the mesh's
+ * bounding box, which must be up to date (see compute_mesh_bounds()). This
+ * halves the memory for positions.
+ *
+ * Each axis is split into 65535 steps, so a decoded position is at most
+ * half a step, the box size / 131070, from the original, plus float
+ * rounding. Prints the memory saved, the largest error seen and the bound.
+ *
+ * The error must stay within QUANTIZE_MAX_ERROR_STEPS steps of the box's
+ * largest axis. If the rounding could take it further, as for a mesh far
+ * from the origin for its size, or the error measured is past the bound,
+ * the mesh keeps its float vertices and this returns false.
+ */
+bool quantize_mesh_vertices(mesh_t* target) {
+    size_t num_vertices = array_length(target->vertices);
+    vec3_t min = target->bounds_min;
+    vec3_t max = target->bounds_max;
+    vec3_t step = {quantize_step(min.x, max.x), quantize_step(min.y, max.y),
+                   quantize_step(min.z, max.z)};
+
+    array_free(target->quantized_vertices);
+    target->quantized_vertices = NULL;
+    array_reserve(target->quantized_vertices, num_vertices);
+    for (size_t i = 0; i < num_vertices; i++) {
+        vec3_t vertex = target->vertices[i];
+        qvec3_t q = {quantize_value(vertex.x, min.x, step.x),
+                     quantize_value(vertex.y, min.y, step.y),
+                     quantize_value(vertex.z, min.z, step.z)};
+        array_push(target->quantized_vertices, q);
+    }
+    target->quantize_scale = step;
+    target->quantize_offset = min;
+
+    float max_error = 0;
+    for (size_t i = 0; i < num_vertices; i++) {
+        vec3_t original = target->vertices[i];
+        vec3_t decoded = mesh_vertex(target, i);
+        float errors[3] = {fabsf(decoded.x - original.x),
+                           fabsf(decoded.y - original.y),
+                           fabsf(decoded.z - original.z)};
+        for (int j = 0; j < 3; j++) {
+            if (errors[j] > max_error) max_error = errors[j];
+        }
+    }
+
+    // Half a step, plus a few float roundings at the size of the coordinates
+    float max_step = step.x;
+    if (step.y > max_step) max_step = step.y;
+    if (step.z > max_step) max_step = step.z;
+    float magnitude = 0;
+    float corners[6] = {min.x, min.y, min.z, max.x, max.y, max.z};
+    for (int i = 0; i < 6; i++) {
+        if (fabsf(corners[i]) > magnitude) magnitude = fabsf(corners[i]);
+    }
+    float bound = max_step / 2 + 4 * FLT_EPSILON * magnitude;
+    float tolerance = max_step * QUANTIZE_MAX_ERROR_STEPS;
+
+    if (bound > tolerance || max_error > bound) {
+        printf("keeping float vertices: quantized error %g (bound %g) is "
+               "over the tolerance %g\n",
+               max_error, bound, tolerance);
+        array_free(target->quantized_vertices);
+        target->quantized_vertices = NULL;
+        return false;
+    }
+
+    array_free(target->vertices);
+    target->vertices = NULL;
+
+    size_t saved = num_vertices * (sizeof(vec3_t) - sizeof(qvec3_t));
+    printf("quantized %zu vertices to 16 bits: saved %zu bytes, max error "
+           "%g (bound %g)\n",
+           num_vertices, saved, max_error, bound);
+    return true;
+}
+
+/**
+ * Free everything the mesh owns, including its texture.
+ */
+void free_mesh(mesh_t* target) {
+    array_free(target->vertices);
+    array_free(target->quantized_vertices);
+    array_free(target->faces);
+    array_free(target->texcoords);
+    array_free(target->edges);
+    array_free(target->wire_vertices);
+    free(target->face_visible);
+    free(target->vertex_visible);
+    free(target->transformed_vertices);
+    free(target->projected_vertices);
+    free_texture(target->texture);
 }
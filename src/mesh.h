@@ -1,6 +1,9 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stdbool.h>
+#include "array.h"
+#include "texture.h"
 #include "triangle.h"
 #include "vector.h"
 
@@ -10,16 +13,81 @@ extern vec3_t cube_vertices[N_CUBE_VERTICES];
 #define N_CUBE_FACES (6 * 2)  // 6 faces with 2 triangles each
 extern face_t cube_faces[N_CUBE_FACES];
 
+// Number of steps across each axis of the bounding box for 16-bit vertices
+#define QUANTIZE_STEPS 65535
+
+// Largest error allowed for 16-bit vertices, in steps: half a step from
+// quantizing plus up to half a step of float rounding
+#define QUANTIZE_MAX_ERROR_STEPS 1.0f
+
+// Marks the missing second face of an open edge
+#define NO_FACE ((size_t)-1)
+
+// An edge of the mesh, stored once however many faces share it. Only the
+// first two faces are kept.
+// Vertex numbering is the same as face_t.
+typedef struct {
+    int a;
+    int b;
+    size_t face_a;  // index into mesh.faces
+    size_t face_b;  // second face, or NO_FACE for an open edge
+} edge_t;
+
 // A struct for dynamic sized meshes
 typedef struct {
-    vec3_t* vertices;  // dynamic array of vertices
-    face_t* faces;     // dynamic array of faces
-    vec3_t rotation;   // rotation with x, y, and z values
+    vec3_t* vertices;    // dynamic array of vertices
+    face_t* faces;       // dynamic array of faces
+    tex2_t* texcoords;   // dynamic array of obj file texture coordinates
+    texture_t* texture;  // texture for the textured render methods
+    vec3_t rotation;     // rotation with x, y, and z values
+    vec3_t bounds_min;   // axis-aligned bounding box of the vertices
+    vec3_t bounds_max;
+
+    // 16-bit vertices that replace `vertices` after quantize_mesh_vertices().
+    // A position is quantize_offset + quantized * quantize_scale.
+    qvec3_t* quantized_vertices;
+    vec3_t quantize_scale;
+    vec3_t quantize_offset;
+
+    // Wireframe data, built once by build_mesh_wireframe()
+    edge_t* edges;       // dynamic array of unique edges
+    int* wire_vertices;  // dynamic array of vertices used by any face
+
+    // Per-frame geometry and wireframe state, indexed like faces and vertices
+    bool* face_visible;
+    bool* vertex_visible;
+    vec3_t* transformed_vertices;
+    vec2_t* projected_vertices;
 } mesh_t;
 
 extern mesh_t mesh;
 
-void load_cube_mesh_data(void);
-void load_obj_file_data(char* filename);
+void load_cube_mesh_data(mesh_t* target);
+bool load_obj_file_data(mesh_t* target, const char* filename);
+void build_mesh_wireframe(mesh_t* target);
+void compute_mesh_bounds(mesh_t* target);
+bool quantize_mesh_vertices(mesh_t* target);
+void free_mesh(mesh_t* target);
+
+static inline size_t mesh_vertex_count(const mesh_t* source) {
+    return source->quantized_vertices != NULL
+               ? array_length(source->quantized_vertices)
+               : array_length(source->vertices);
+}
+
+/**
+ * Get a vertex position, decoding it if the mesh is quantized.
+ */
+static inline vec3_t mesh_vertex(const mesh_t* source, size_t index) {
+    if (source->quantized_vertices == NULL) {
+        return source->vertices[index];
+    }
+    qvec3_t q = source->quantized_vertices[index];
+    vec3_t vertex = {
+        source->quantize_offset.x + q.x * source->quantize_scale.x,
+        source->quantize_offset.y + q.y * source->quantize_scale.y,
+        source->quantize_offset.z + q.z * source->quantize_scale.z};
+    return vertex;
+}
 
 #endif
@@ -0,0 +1,287 @@
+#include "occlusion.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A pyramid of coarse depth buffers. Level 0 has one cell per
+// OCCLUSION_CELL_SIZE pixels, and each level above halves the resolution.
+// A cell holds the farthest occluder depth anywhere under it, so if an
+// object is behind a cell's depth, it is behind every occluder in the cell.
+// Cells the occluders don't fully cover are at FLT_MAX.
+//
+// Level 0 is built from the union of the occluder triangles, so a cell
+// that two triangles cover between them counts: a cell is covered when
+// all four of its corners are inside some triangle and no silhouette edge
+// of the occluders passes through it.
+typedef struct {
+    int width;
+    int height;
+    float* depths;
+} depth_level_t;
+
+static struct {
+    int screen_width;
+    int screen_height;
+    int num_levels;
+    depth_level_t levels[OCCLUSION_MAX_LEVELS];
+
+    // Scratch for level 0, one more across and down than its cells
+    bool* is_corner_covered;  // per cell corner
+    float* farthest;  // per cell: farthest depth of any triangle touching it
+} occlusion;
+
+/**
+ * Size the pyramid for the screen and clear it to "no occluder".
+ */
+void occlusion_begin(int screen_width, int screen_height) {
+    if (occlusion.screen_width != screen_width ||
+        occlusion.screen_height != screen_height) {
+        occlusion_free();
+        occlusion.screen_width = screen_width;
+        occlusion.screen_height = screen_height;
+
+        int width = (screen_width + OCCLUSION_CELL_SIZE - 1) /
+                    OCCLUSION_CELL_SIZE;
+        int height = (screen_height + OCCLUSION_CELL_SIZE - 1) /
+                     OCCLUSION_CELL_SIZE;
+        while (occlusion.num_levels < OCCLUSION_MAX_LEVELS) {
+            depth_level_t* level = &occlusion.levels[occlusion.num_levels++];
+            level->width = width;
+            level->height = height;
+            level->depths = (float*)malloc(sizeof(float) * width * height);
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+
+        depth_level_t* base = &occlusion.levels[0];
+        occlusion.is_corner_covered = (bool*)malloc(
+            sizeof(bool) * (base->width + 1) * (base->height + 1));
+        occlusion.farthest =
+            (float*)malloc(sizeof(float) * base->width * base->height);
+    }
+
+    depth_level_t* base = &occlusion.levels[0];
+    memset(occlusion.is_corner_covered, 0,
+           sizeof(bool) * (base->width + 1) * (base->height + 1));
+    for (int i = 0; i < base->width * base->height; i++) {
+        occlusion.farthest[i] = 0;
+    }
+}
+
+static float edge_function(vec2_t a, vec2_t b, float x, float y) {
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+/**
+ * Find the range of level 0 cells whose closed squares can touch the
+ * screen-space box from (min_x, min_y) to (max_x, max_y). Returns false if
+ * there are none.
+ */
+static bool touched_cells(float min_x, float min_y, float max_x, float max_y,
+                          int* cell_x0, int* cell_y0, int* cell_x1,
+                          int* cell_y1) {
+    depth_level_t* base = &occlusion.levels[0];
+    float x0 = floorf(min_x / OCCLUSION_CELL_SIZE) - 1;
+    float y0 = floorf(min_y / OCCLUSION_CELL_SIZE) - 1;
+    float x1 = floorf(max_x / OCCLUSION_CELL_SIZE);
+    float y1 = floorf(max_y / OCCLUSION_CELL_SIZE);
+    if (x1 < 0 || y1 < 0 || x0 >= base->width || y0 >= base->height) {
+        return false;
+    }
+    *cell_x0 = x0 < 0 ? 0 : (int)x0;
+    *cell_y0 = y0 < 0 ? 0 : (int)y0;
+    *cell_x1 = x1 >= base->width ? base->width - 1 : (int)x1;
+    *cell_y1 = y1 >= base->height ? base->height - 1 : (int)y1;
+    return true;
+}
+
+/**
+ * Rasterize an occluder triangle into level 0 at a single depth. Pass the
+ * triangle's farthest depth so the result stays conservative.
+ *
+ * Marks the cell corners inside the triangle, and raises the depth of
+ * every cell the triangle might touch to its depth. Only cells inside the
+ * occluders' silhouette can end up covered, see occlusion_draw_edge().
+ */
+void occlusion_draw_triangle(vec2_t p0, vec2_t p1, vec2_t p2, float depth) {
+    depth_level_t* base = &occlusion.levels[0];
+    float area = edge_function(p0, p1, p2.x, p2.y);
+    if (area == 0) {
+        return;
+    }
+    float sign = area > 0 ? 1.0f : -1.0f;
+
+    float min_x = fminf(p0.x, fminf(p1.x, p2.x));
+    float max_x = fmaxf(p0.x, fmaxf(p1.x, p2.x));
+    float min_y = fminf(p0.y, fminf(p1.y, p2.y));
+    float max_y = fmaxf(p0.y, fmaxf(p1.y, p2.y));
+    int cell_x0, cell_y0, cell_x1, cell_y1;
+    if (!touched_cells(min_x, min_y, max_x, max_y, &cell_x0, &cell_y0,
+                       &cell_x1, &cell_y1)) {
+        return;
+    }
+
+    for (int cy = cell_y0; cy <= cell_y1; cy++) {
+        for (int cx = cell_x0; cx <= cell_x1; cx++) {
+            float* farthest = &occlusion.farthest[(base->width * cy) + cx];
+            if (depth > *farthest) {
+                *farthest = depth;
+            }
+        }
+    }
+
+    // Corners run one past the last cell
+    for (int cy = cell_y0; cy <= cell_y1 + 1; cy++) {
+        float y = cy * OCCLUSION_CELL_SIZE;
+        for (int cx = cell_x0; cx <= cell_x1 + 1; cx++) {
+            float x = cx * OCCLUSION_CELL_SIZE;
+            if (sign * edge_function(p0, p1, x, y) >= 0 &&
+                sign * edge_function(p1, p2, x, y) >= 0 &&
+                sign * edge_function(p2, p0, x, y) >= 0) {
+                occlusion.is_corner_covered[((base->width + 1) * cy) + cx] =
+                    true;
+            }
+        }
+    }
+}
+
+/**
+ * Mark an edge of the occluders' silhouette: an edge with a drawn triangle
+ * on only one side. No cell it touches counts as covered, even if all of
+ * the cell's corners are, since part of the cell is outside the occluders.
+ */
+void occlusion_draw_edge(vec2_t a, vec2_t b) {
+    depth_level_t* base = &occlusion.levels[0];
+    int cell_x0, cell_y0, cell_x1, cell_y1;
+    if (!touched_cells(fminf(a.x, b.x), fminf(a.y, b.y), fmaxf(a.x, b.x),
+                       fmaxf(a.y, b.y), &cell_x0, &cell_y0, &cell_x1,
+                       &cell_y1)) {
+        return;
+    }
+
+    for (int cy = cell_y0; cy <= cell_y1; cy++) {
+        float y0 = cy * OCCLUSION_CELL_SIZE;
+        float y1 = y0 + OCCLUSION_CELL_SIZE;
+        for (int cx = cell_x0; cx <= cell_x1; cx++) {
+            float x0 = cx * OCCLUSION_CELL_SIZE;
+            float x1 = x0 + OCCLUSION_CELL_SIZE;
+
+            // The edge misses the cell if all four corners are strictly on
+            // one side of its line
+            float e00 = edge_function(a, b, x0, y0);
+            float e10 = edge_function(a, b, x1, y0);
+            float e01 = edge_function(a, b, x0, y1);
+            float e11 = edge_function(a, b, x1, y1);
+            if ((e00 > 0 && e10 > 0 && e01 > 0 && e11 > 0) ||
+                (e00 < 0 && e10 < 0 && e01 < 0 && e11 < 0)) {
+                continue;
+            }
+            occlusion.farthest[(base->width * cy) + cx] = FLT_MAX;
+        }
+    }
+}
+
+/**
+ * Resolve level 0 from the drawn triangles and edges, then fill in the
+ * coarser levels. Each cell takes the farthest of the (up to four) cells
+ * below it.
+ */
+void occlusion_build_pyramid(void) {
+    depth_level_t* base = &occlusion.levels[0];
+    int corners_width = base->width + 1;
+    for (int y = 0; y < base->height; y++) {
+        const bool* row = &occlusion.is_corner_covered[corners_width * y];
+        for (int x = 0; x < base->width; x++) {
+            bool is_covered = row[x] && row[x + 1] &&
+                              row[corners_width + x] &&
+                              row[corners_width + x + 1];
+            base->depths[(base->width * y) + x] =
+                is_covered ? occlusion.farthest[(base->width * y) + x]
+                           : FLT_MAX;
+        }
+    }
+
+    for (int i = 1; i < occlusion.num_levels; i++) {
+        depth_level_t* below = &occlusion.levels[i - 1];
+        depth_level_t* level = &occlusion.levels[i];
+
+        for (int y = 0; y < level->height; y++) {
+            int y0 = y * 2;
+            int y1 = (y0 + 1 < below->height) ? y0 + 1 : y0;
+            for (int x = 0; x < level->width; x++) {
+                int x0 = x * 2;
+                int x1 = (x0 + 1 < below->width) ? x0 + 1 : x0;
+                float farthest =
+                    fmaxf(fmaxf(below->depths[below->width * y0 + x0],
+                                below->depths[below->width * y0 + x1]),
+                          fmaxf(below->depths[below->width * y1 + x0],
+                                below->depths[below->width * y1 + x1]));
+                level->depths[(level->width * y) + x] = farthest;
+            }
+        }
+    }
+}
+
+/**
+ * Test a screen-space rectangle whose nearest point is at `min_depth`.
+ *
+ * Reads from the finest level where the rectangle spans no more than
+ * OCCLUSION_MAX_TEST_CELLS cells each way. Coarser levels are cheaper to
+ * read but their cells stick out past the rectangle, which makes the test
+ * more conservative. Rectangles that are entirely off screen are
+ * reported as not visible too.
+ */
+bool occlusion_is_visible(float min_x, float min_y, float max_x, float max_y,
+                          float min_depth) {
+    if (max_x < 0 || max_y < 0 || min_x >= occlusion.screen_width ||
+        min_y >= occlusion.screen_height) {
+        return false;
+    }
+
+    int x0 = min_x < 0 ? 0 : (int)min_x / OCCLUSION_CELL_SIZE;
+    int y0 = min_y < 0 ? 0 : (int)min_y / OCCLUSION_CELL_SIZE;
+    int x1 = (max_x >= occlusion.screen_width ? occlusion.screen_width - 1
+                                              : (int)max_x) /
+             OCCLUSION_CELL_SIZE;
+    int y1 = (max_y >= occlusion.screen_height ? occlusion.screen_height - 1
+                                               : (int)max_y) /
+             OCCLUSION_CELL_SIZE;
+
+    int level_index = 0;
+    while (level_index < occlusion.num_levels - 1 &&
+           (x1 - x0 >= OCCLUSION_MAX_TEST_CELLS ||
+            y1 - y0 >= OCCLUSION_MAX_TEST_CELLS)) {
+        x0 /= 2;
+        y0 /= 2;
+        x1 /= 2;
+        y1 /= 2;
+        level_index++;
+    }
+
+    depth_level_t* level = &occlusion.levels[level_index];
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (level->depths[(level->width * y) + x] >= min_depth) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void occlusion_free(void) {
+    for (int i = 0; i < occlusion.num_levels; i++) {
+        free(occlusion.levels[i].depths);
+    }
+    free(occlusion.is_corner_covered);
+    free(occlusion.farthest);
+    occlusion.is_corner_covered = NULL;
+    occlusion.farthest = NULL;
+    occlusion.num_levels = 0;
+    occlusion.screen_width = 0;
+    occlusion.screen_height = 0;
+}
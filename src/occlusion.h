@@ -0,0 +1,23 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+#include "vector.h"
+
+// Each cell of the coarse depth buffer covers this many pixels squared
+#define OCCLUSION_CELL_SIZE 8
+#define OCCLUSION_MAX_LEVELS 16
+
+// A visibility test reads at most this many cells across and down, from the
+// finest level where the object fits
+#define OCCLUSION_MAX_TEST_CELLS 16
+
+void occlusion_begin(int screen_width, int screen_height);
+void occlusion_draw_triangle(vec2_t p0, vec2_t p1, vec2_t p2, float depth);
+void occlusion_draw_edge(vec2_t a, vec2_t b);
+void occlusion_build_pyramid(void);
+bool occlusion_is_visible(float min_x, float min_y, float max_x, float max_y,
+                          float min_depth);
+void occlusion_free(void);
+
+#endif
@@ -0,0 +1,148 @@
+// shm_open() and clock_gettime() are POSIX, outside of plain C99
+#define _POSIX_C_SOURCE 200112L
+
+#include "shm_output.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// The render loop draws straight into one slot of the shared ring (it is
+// the color buffer), publishes it when the frame is done, and moves on to
+// the next slot. Readers map the same object and never copy through us.
+static struct {
+    bool is_running;
+    char name[256];
+    size_t map_size;
+    shm_ring_header_t* ring;
+    int slot;            // slot being drawn into
+    uint64_t sequence;  // sequence number of the frame being drawn
+} shm;
+
+static shm_frame_header_t* frame_header(int slot) {
+    return (shm_frame_header_t*)((uint8_t*)shm.ring + shm.ring->frames_offset +
+                                 (size_t)slot * shm.ring->frame_stride);
+}
+
+static uint32_t* frame_pixels(int slot) {
+    return (uint32_t*)(frame_header(slot) + 1);
+}
+
+/**
+ * Mark a slot as being drawn, before any of its pixels change.
+ */
+static void begin_frame(int slot) {
+    __atomic_store_n(&frame_header(slot)->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Create the shared memory object `name` (like "/3drenderer") holding a
+ * ring of num_frames frames.
+ *
+ * Returns the pixels of the first frame to draw into, or NULL if the
+ * object can't be created.
+ */
+uint32_t* shm_output_start(const char* name, int width, int height,
+                           int num_frames) {
+    if (num_frames < 2 || num_frames > SHM_OUTPUT_MAX_FRAMES) {
+        printf("shared memory frames must be 2 to %d, not %d\n",
+               SHM_OUTPUT_MAX_FRAMES, num_frames);
+        return NULL;
+    }
+
+    // Keep each frame on its own cache lines
+    size_t pixels_size = (size_t)width * height * sizeof(uint32_t);
+    size_t frames_offset = (sizeof(shm_ring_header_t) + 63) & ~(size_t)63;
+    size_t frame_stride =
+        (sizeof(shm_frame_header_t) + pixels_size + 63) & ~(size_t)63;
+    size_t map_size = frames_offset + frame_stride * num_frames;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, map_size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name);
+        return NULL;
+    }
+
+    snprintf(shm.name, sizeof(shm.name), "%s", name);
+    shm.map_size = map_size;
+    shm.ring = (shm_ring_header_t*)map;
+    shm.slot = 0;
+    shm.sequence = 1;
+
+    // The object starts zeroed, so every frame's sequence is already 0
+    shm.ring->version = SHM_OUTPUT_VERSION;
+    shm.ring->width = width;
+    shm.ring->height = height;
+    shm.ring->num_frames = num_frames;
+    shm.ring->frame_stride = frame_stride;
+    shm.ring->frames_offset = frames_offset;
+    for (int i = 0; i < num_frames; i++) {
+        frame_header(i)->size = pixels_size;
+    }
+
+    // Readers check the magic last, once the rest of the header is set
+    __atomic_store_n(&shm.ring->magic, SHM_OUTPUT_MAGIC, __ATOMIC_RELEASE);
+
+    shm.is_running = true;
+    printf("sharing %d frames of %dx%d in %s\n", num_frames, width, height,
+           name);
+    return frame_pixels(shm.slot);
+}
+
+bool shm_output_is_running(void) { return shm.is_running; }
+
+/**
+ * Publish the frame that was just drawn, and return the pixels of the next
+ * slot to draw into. The next slot is the oldest frame in the ring, so a
+ * reader has num_frames - 1 frames of time to finish with a frame.
+ */
+uint32_t* shm_output_publish_frame(void) {
+    shm_frame_header_t* header = frame_header(shm.slot);
+    header->timestamp_ns = monotonic_ns();
+    __atomic_store_n(&header->sequence, shm.sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm.ring->latest_sequence, shm.sequence,
+                     __ATOMIC_RELEASE);
+
+    shm.sequence++;
+    shm.slot = (shm.slot + 1) % shm.ring->num_frames;
+    begin_frame(shm.slot);
+    return frame_pixels(shm.slot);
+}
+
+/**
+ * Tell readers that no more frames are coming, then unmap and remove the
+ * object. Readers that still have it mapped keep their mapping.
+ */
+void shm_output_stop(void) {
+    if (!shm.is_running) {
+        return;
+    }
+
+    __atomic_store_n(&shm.ring->is_closed, 1, __ATOMIC_RELEASE);
+    munmap(shm.ring, shm.map_size);
+    shm_unlink(shm.name);
+    memset(&shm, 0, sizeof(shm));
+}
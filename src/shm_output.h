@@ -0,0 +1,46 @@
+#ifndef SHM_OUTPUT_H
+#define SHM_OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// This header is shared with other processes that read the frames (see
+// tools/frame_reader.c), so it only uses fixed size types and no SDL.
+
+#define SHM_OUTPUT_MAGIC 0x46524433  // "3DRF"
+#define SHM_OUTPUT_VERSION 1
+#define SHM_OUTPUT_DEFAULT_FRAMES 3
+#define SHM_OUTPUT_MAX_FRAMES 64
+
+// At the start of the shared memory object. Frame i's header is at
+// frames_offset + i * frame_stride, and its pixels follow the header.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_frames;
+    uint32_t frame_stride;     // bytes from one frame header to the next
+    uint32_t frames_offset;    // bytes from the start to the first frame
+    uint32_t is_closed;        // set when the renderer stops
+    uint64_t latest_sequence;  // newest finished frame, 0 before the first
+} shm_ring_header_t;
+
+// Frame n (counting from 1) is in slot (n - 1) % num_frames. The renderer
+// sets sequence to 0 before drawing into a slot again, so a reader that
+// sees the same non-zero sequence before and after reading the pixels got
+// a whole frame.
+typedef struct {
+    uint64_t sequence;
+    uint64_t size;          // bytes of ARGB8888 pixels, width * height * 4
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC time the frame was finished
+    uint64_t reserved;
+} shm_frame_header_t;
+
+uint32_t* shm_output_start(const char* name, int width, int height,
+                           int num_frames);
+bool shm_output_is_running(void);
+uint32_t* shm_output_publish_frame(void);
+void shm_output_stop(void);
+
+#endif
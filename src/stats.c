@@ -0,0 +1,75 @@
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+raster_stats_t raster_stats;
+uint16_t* overdraw_buffer = NULL;
+bool is_counting_raster = true;
+
+static uint16_t* overdraw_storage = NULL;
+static int overdraw_size = 0;
+static int frame_number = 0;
+
+/**
+ * Reset the counters, and clear the overdraw buffer if pixel writes are
+ * being counted this frame.
+ */
+void stats_begin_frame(bool is_counting_pixels, int num_pixels) {
+    memset(&raster_stats, 0, sizeof(raster_stats));
+    frame_number++;
+
+    if (!is_counting_pixels) {
+        overdraw_buffer = NULL;
+        return;
+    }
+
+    if (overdraw_size != num_pixels) {
+        free(overdraw_storage);
+        overdraw_storage = (uint16_t*)malloc(sizeof(uint16_t) * num_pixels);
+        overdraw_size = num_pixels;
+    }
+    memset(overdraw_storage, 0, sizeof(uint16_t) * num_pixels);
+    overdraw_buffer = overdraw_storage;
+}
+
+void stats_print_frame(void) {
+    int unique_pixels =
+        raster_stats.pixels_written - raster_stats.pixels_overwritten;
+    printf("frame %d: faces %d, culled %d, occluded %d, rasterized %d, "
+           "pixels %d, overwritten %d, overdraw %.2fx\n",
+           frame_number, raster_stats.faces_in, raster_stats.faces_culled,
+           raster_stats.faces_occluded, raster_stats.triangles_rasterized,
+           raster_stats.pixels_written, raster_stats.pixels_overwritten,
+           unique_pixels > 0
+               ? (double)raster_stats.pixels_written / unique_pixels
+               : 0.0);
+}
+
+/**
+ * Replace the frame with a heatmap of the overdraw buffer: black for
+ * untouched pixels, then blue, green, yellow, orange and red as the write
+ * count goes up, and white for 8 or more writes.
+ */
+void draw_overdraw_heatmap(uint32_t* buffer, int num_pixels) {
+    static const uint32_t heat_colors[] = {
+        0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFFFFFF00, 0xFFFFB000,
+        0xFFFF6000, 0xFFFF0000, 0xFFFF00FF, 0xFFFFFFFF};
+    int max_heat = sizeof(heat_colors) / sizeof(heat_colors[0]) - 1;
+
+    if (overdraw_buffer == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < num_pixels; i++) {
+        int count = overdraw_buffer[i];
+        buffer[i] = heat_colors[count < max_heat ? count : max_heat];
+    }
+}
+
+void stats_free(void) {
+    free(overdraw_storage);
+    overdraw_storage = NULL;
+    overdraw_buffer = NULL;
+    overdraw_size = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-frame counters from the geometry and raster stages
+typedef struct {
+    int faces_in;            // faces that entered the face loop
+    int faces_culled;        // faces removed by backface culling
+    int faces_occluded;      // faces skipped because the mesh was occluded
+    int triangles_rasterized;
+    int pixels_written;      // every triangle write to the color buffer
+    int pixels_overwritten;  // writes to a pixel already written this frame
+} raster_stats_t;
+
+extern raster_stats_t raster_stats;
+
+// The raster counters only measure the mesh's triangles. This is turned
+// off while the occluders are drawn.
+extern bool is_counting_raster;
+
+// Number of writes to each pixel this frame. Only set while something needs
+// it (--stats or the overdraw render method), so the raster loops can skip
+// the counting otherwise.
+extern uint16_t* overdraw_buffer;
+
+void stats_begin_frame(bool is_counting_pixels, int num_pixels);
+void stats_print_frame(void);
+void draw_overdraw_heatmap(uint32_t* buffer, int num_pixels);
+void stats_free(void);
+
+/**
+ * Record a write to the pixel at `index`. Call only when overdraw_buffer is
+ * set.
+ */
+static inline void count_pixel_write(int index) {
+    raster_stats.pixels_written++;
+    if (overdraw_buffer[index]++ > 0) {
+        raster_stats.pixels_overwritten++;
+    }
+}
+
+#endif
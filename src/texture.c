@@ -0,0 +1,211 @@
+#include "texture.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "image.h"
+
+/**
+ * Spread the low 16 bits of `value` out so that there is a zero bit between
+ * each of them (0b1011 becomes 0b1000101).
+ */
+static uint32_t spread_bits(uint32_t value) {
+    value &= 0x0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+static int log2_int(int value) {
+    int result = 0;
+    while ((1 << result) < value) {
+        result++;
+    }
+    return result;
+}
+
+/**
+ * Average four ARGB colors channel by channel.
+ */
+static uint32_t average_colors(uint32_t a, uint32_t b, uint32_t c,
+                               uint32_t d) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) +
+                       ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+        result |= ((sum + 2) / 4) << shift;
+    }
+    return result;
+}
+
+/**
+ * Build the Morton offset tables for a level and copy the row-major pixels
+ * into Z-order.
+ *
+ * For a non-square level the square part is interleaved, and the leftover
+ * high bits of the longer side go above it, so the index stays below
+ * width * height.
+ */
+static void init_mip_level(mip_level_t* level, const uint32_t* pixels,
+                           int width, int height) {
+    int square_bits = log2_int(width < height ? width : height);
+    uint32_t square_mask = (1u << square_bits) - 1;
+
+    level->width = width;
+    level->height = height;
+    level->texels = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+    level->x_offsets = (uint32_t*)malloc(sizeof(uint32_t) * width);
+    level->y_offsets = (uint32_t*)malloc(sizeof(uint32_t) * height);
+
+    for (int x = 0; x < width; x++) {
+        level->x_offsets[x] = spread_bits(x & square_mask) |
+                              ((x >> square_bits) << (2 * square_bits));
+    }
+    for (int y = 0; y < height; y++) {
+        level->y_offsets[y] = (spread_bits(y & square_mask) << 1) |
+                              ((y >> square_bits) << (2 * square_bits));
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            level->texels[level->x_offsets[x] | level->y_offsets[y]] =
+                pixels[(width * y) + x];
+        }
+    }
+}
+
+/**
+ * Create a texture with a full mip chain from row-major ARGB pixels.
+ *
+ * Sizes that are not a power of two are resampled up to the next power of
+ * two, so texel coordinates can wrap with a mask.
+ */
+texture_t* create_texture(const uint32_t* pixels, int width, int height) {
+    int max_size = 1 << (MAX_MIP_LEVELS - 1);
+    if (width <= 0 || height <= 0 || width > max_size || height > max_size) {
+        return NULL;
+    }
+
+    texture_t* texture = (texture_t*)malloc(sizeof(texture_t));
+    int level_width = 1 << log2_int(width);
+    int level_height = 1 << log2_int(height);
+
+    // Nearest-neighbor resample into a row-major power-of-two level 0
+    uint32_t* current =
+        (uint32_t*)malloc(sizeof(uint32_t) * level_width * level_height);
+    for (int y = 0; y < level_height; y++) {
+        int src_y = (y * height) / level_height;
+        for (int x = 0; x < level_width; x++) {
+            int src_x = (x * width) / level_width;
+            current[(level_width * y) + x] = pixels[(width * src_y) + src_x];
+        }
+    }
+
+    texture->num_levels = 0;
+    while (1) {
+        init_mip_level(&texture->levels[texture->num_levels], current,
+                       level_width, level_height);
+        texture->num_levels++;
+
+        if (level_width == 1 && level_height == 1) {
+            break;
+        }
+
+        // Box filter the current level down into the next one
+        int next_width = level_width > 1 ? level_width / 2 : 1;
+        int next_height = level_height > 1 ? level_height / 2 : 1;
+        int step_x = level_width > 1 ? 1 : 0;
+        int step_y = level_height > 1 ? level_width : 0;
+        uint32_t* next =
+            (uint32_t*)malloc(sizeof(uint32_t) * next_width * next_height);
+        for (int y = 0; y < next_height; y++) {
+            for (int x = 0; x < next_width; x++) {
+                int src = (y * 2 * step_y) + (x * 2 * step_x);
+                next[(next_width * y) + x] =
+                    average_colors(current[src], current[src + step_x],
+                                   current[src + step_y],
+                                   current[src + step_x + step_y]);
+            }
+        }
+
+        free(current);
+        current = next;
+        level_width = next_width;
+        level_height = next_height;
+    }
+
+    free(current);
+    return texture;
+}
+
+/**
+ * Create a square checkerboard texture with 8x8 squares.
+ */
+texture_t* create_checker_texture(int size, uint32_t color_a,
+                                  uint32_t color_b) {
+    uint32_t* pixels = (uint32_t*)malloc(sizeof(uint32_t) * size * size);
+    int square = size / 8 > 0 ? size / 8 : 1;
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int is_a = ((x / square) + (y / square)) % 2 == 0;
+            pixels[(size * y) + x] = is_a ? color_a : color_b;
+        }
+    }
+
+    texture_t* texture = create_texture(pixels, size, size);
+    free(pixels);
+    return texture;
+}
+
+/**
+ * Load a binary (P6) PPM file as a texture.
+ */
+texture_t* load_ppm_texture(const char* filename) {
+    int width;
+    int height;
+    uint32_t* pixels = load_ppm_image(filename, &width, &height);
+    if (pixels == NULL) {
+        return NULL;
+    }
+
+    texture_t* texture = create_texture(pixels, width, height);
+    free(pixels);
+    return texture;
+}
+
+/**
+ * Pick the mip level whose texel density best matches the screen.
+ *
+ * uv_area is the triangle's area in UV space (0..1) and screen_area is its
+ * area in pixels. A ratio of 4 texels per pixel means level 1, and so on.
+ */
+int texture_mip_level(const texture_t* texture, float uv_area,
+                      float screen_area) {
+    if (screen_area <= 0) {
+        return texture->num_levels - 1;
+    }
+
+    float texel_area = uv_area * texture->levels[0].width *
+                       texture->levels[0].height;
+    if (texel_area <= screen_area) {
+        return 0;
+    }
+
+    int level = (int)(0.5f * log2f(texel_area / screen_area) + 0.5f);
+    return level < texture->num_levels ? level : texture->num_levels - 1;
+}
+
+void free_texture(texture_t* texture) {
+    if (texture == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < texture->num_levels; i++) {
+        free(texture->levels[i].texels);
+        free(texture->levels[i].x_offsets);
+        free(texture->levels[i].y_offsets);
+    }
+    free(texture);
+}
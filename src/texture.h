@@ -0,0 +1,49 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stdint.h>
+
+// UV coordinates, where (0,0) is the top left of the texture
+typedef struct {
+    float u;
+    float v;
+} tex2_t;
+
+#define MAX_MIP_LEVELS 16
+
+// One level of the mip chain. Texels are stored in Morton (Z-order) so that
+// texels that are close in 2D are also close in memory. The offset tables
+// hold the interleaved Morton bits for each column and row, so a fetch is
+// `texels[x_offsets[x] | y_offsets[y]]`.
+typedef struct {
+    int width;  // always a power of two
+    int height;
+    uint32_t* texels;
+    uint32_t* x_offsets;
+    uint32_t* y_offsets;
+} mip_level_t;
+
+// A texture with its full mip chain, from level 0 (full size) down to 1x1.
+typedef struct {
+    int num_levels;
+    mip_level_t levels[MAX_MIP_LEVELS];
+} texture_t;
+
+texture_t* create_texture(const uint32_t* pixels, int width, int height);
+texture_t* create_checker_texture(int size, uint32_t color_a,
+                                  uint32_t color_b);
+texture_t* load_ppm_texture(const char* filename);
+int texture_mip_level(const texture_t* texture, float uv_area,
+                      float screen_area);
+void free_texture(texture_t* texture);
+
+/**
+ * Fetch the texel at (x, y) of a mip level. Coordinates wrap around.
+ */
+static inline uint32_t texture_fetch(const mip_level_t* level, int x, int y) {
+    x &= level->width - 1;
+    y &= level->height - 1;
+    return level->texels[level->x_offsets[x] | level->y_offsets[y]];
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "triangle.h"
+#include <math.h>
 #include "display.h"
+#include "stats.h"
 
 void int_swap(int* a, int* b) {
     int tmp = *a;
@@ -30,7 +32,7 @@ void fill_flat_bottom_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
 
     // Loop over the scanlines from top to bottom
     for (int y = y0; y <= y2; y++) {
-        draw_line(x_start, y, x_end, y, color);
+        draw_span(x_start, x_end, y, color);
         x_start += inverted_slope_1;
         x_end += inverted_slope_2;
     }
@@ -62,7 +64,7 @@ void fill_flat_top_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
 
     // Loop over the scanlines from bottom to top
     for (int y = y2; y >= y0; y--) {
-        draw_line(x_start, y, x_end, y, color);
+        draw_span(x_start, x_end, y, color);
         x_start -= inverted_slope_1;
         x_end -= inverted_slope_2;
     }
@@ -89,6 +91,10 @@ void fill_flat_top_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
 //
 void draw_filled_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
                           uint32_t color) {
+    if (is_counting_raster) {
+        raster_stats.triangles_rasterized++;
+    }
+
     // Sort the vertices by y-coordinate, ascending (y0 < y1 < y2)
     if (y0 > y1) {
         int_swap(&y0, &y1);
@@ -129,3 +135,123 @@ void draw_filled_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
     // Draw flat-top triangle
     fill_flat_top_triangle(x1, y1, Mx, My, x2, y2, color);
 }
+
+// Draw a triangle with perspective-correct texture mapping.
+//
+// u/w, v/w and 1/w are linear in screen space, so their gradients are set
+// up once per triangle and stepped across each span. Dividing by the
+// interpolated 1/w per pixel gives back the perspective-correct u and v.
+// The mip level is chosen once per triangle from the ratio of its UV area
+// to its screen area.
+void draw_textured_triangle(const triangle_t* triangle,
+                            const texture_t* texture) {
+    int x0 = triangle->points[0].x, y0 = triangle->points[0].y;
+    int x1 = triangle->points[1].x, y1 = triangle->points[1].y;
+    int x2 = triangle->points[2].x, y2 = triangle->points[2].y;
+
+    // Twice the signed screen area; zero means a degenerate triangle
+    float det = (float)((x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0));
+    if (det == 0) {
+        return;
+    }
+
+    // Attributes at each vertex: 1/w, u/w and v/w
+    float attrs[3][3];
+    for (int i = 0; i < 3; i++) {
+        if (triangle->depths[i] <= 0) {
+            return;  // behind the camera, there is no clipping yet
+        }
+        float inv_w = 1.0f / triangle->depths[i];
+        attrs[i][0] = inv_w;
+        attrs[i][1] = triangle->texcoords[i].u * inv_w;
+        attrs[i][2] = triangle->texcoords[i].v * inv_w;
+    }
+    if (is_counting_raster) {
+        raster_stats.triangles_rasterized++;
+    }
+
+    // Screen space gradients of each attribute, anchored at (x0,y0)
+    float grad_x[3], grad_y[3], base[3];
+    for (int k = 0; k < 3; k++) {
+        float d1 = attrs[1][k] - attrs[0][k];
+        float d2 = attrs[2][k] - attrs[0][k];
+        grad_x[k] = (d1 * (y2 - y0) - d2 * (y1 - y0)) / det;
+        grad_y[k] = (d2 * (x1 - x0) - d1 * (x2 - x0)) / det;
+        base[k] = attrs[0][k];
+    }
+    int base_x = x0;
+    int base_y = y0;
+
+    tex2_t uv0 = triangle->texcoords[0];
+    tex2_t uv1 = triangle->texcoords[1];
+    tex2_t uv2 = triangle->texcoords[2];
+    float uv_area = fabsf((uv1.u - uv0.u) * (uv2.v - uv0.v) -
+                          (uv2.u - uv0.u) * (uv1.v - uv0.v));
+    const mip_level_t* level =
+        &texture->levels[texture_mip_level(texture, uv_area, fabsf(det))];
+
+    // Sort the vertices by y-coordinate, ascending (y0 < y1 < y2). The
+    // gradients above don't depend on the order.
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+    }
+
+    if (y1 > y2) {
+        int_swap(&y1, &y2);
+        int_swap(&x1, &x2);
+    }
+
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+    }
+
+    int y_start = y0 < 0 ? 0 : y0;
+    int y_end = y2 >= window_height ? window_height - 1 : y2;
+    float long_slope = (float)(x2 - x0) / (y2 - y0);
+
+    for (int y = y_start; y <= y_end; y++) {
+        // The long edge runs from top to bottom; the short side switches
+        // from (x0,y0)-(x1,y1) to (x1,y1)-(x2,y2) at the middle vertex.
+        float x_long = x0 + (y - y0) * long_slope;
+        float x_short;
+        if (y < y1) {
+            x_short = x0 + (y - y0) * (float)(x1 - x0) / (y1 - y0);
+        } else if (y2 != y1) {
+            x_short = x1 + (y - y1) * (float)(x2 - x1) / (y2 - y1);
+        } else {
+            x_short = x1;
+        }
+
+        int x_start = (x_long < x_short) ? x_long : x_short;
+        int x_end = (x_long < x_short) ? x_short : x_long;
+        if (x_start < 0) x_start = 0;
+        if (x_end >= window_width) x_end = window_width - 1;
+        if (x_start > x_end) continue;
+
+        float inv_w = base[0] + grad_x[0] * (x_start - base_x) +
+                      grad_y[0] * (y - base_y);
+        float u_over_w = base[1] + grad_x[1] * (x_start - base_x) +
+                         grad_y[1] * (y - base_y);
+        float v_over_w = base[2] + grad_x[2] * (x_start - base_x) +
+                         grad_y[2] * (y - base_y);
+
+        uint32_t* row = &color_buffer[window_width * y];
+        if (overdraw_buffer != NULL && is_counting_raster) {
+            for (int x = x_start; x <= x_end; x++) {
+                count_pixel_write((window_width * y) + x);
+            }
+        }
+        for (int x = x_start; x <= x_end; x++) {
+            float w = 1.0f / inv_w;
+            int tex_x = (int)(u_over_w * w * level->width);
+            int tex_y = (int)(v_over_w * w * level->height);
+            row[x] = texture_fetch(level, tex_x, tex_y);
+
+            inv_w += grad_x[0];
+            u_over_w += grad_x[1];
+            v_over_w += grad_x[2];
+        }
+    }
+}
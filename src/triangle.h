@@ -2,6 +2,7 @@
 #define TRIANGLE_H
 
 #include <stdint.h>
+#include "texture.h"
 #include "vector.h"
 
 // Stores the vertex indices
@@ -9,16 +10,23 @@ typedef struct {
     int a;
     int b;
     int c;
+    tex2_t a_uv;
+    tex2_t b_uv;
+    tex2_t c_uv;
     uint32_t color;
 } face_t;
 
 // Stores the vec2 points of the triangle on the screen
 typedef struct {
     vec2_t points[3];
+    float depths[3];  // view space z of each point, used for perspective
+    tex2_t texcoords[3];
     uint32_t color;
 } triangle_t;
 
 void draw_filled_triangle(int x0, int y0, int x1, int y1, int x2, int y2,
                           uint32_t color);
+void draw_textured_triangle(const triangle_t* triangle,
+                            const texture_t* texture);
 
 #endif
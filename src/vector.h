@@ -1,9 +1,15 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <stdint.h>
+
 typedef struct { float x, y; } vec2_t;
 typedef struct { float x, y, z; } vec3_t;
 
+// A position stored as 16-bit steps across a bounding box, see
+// quantize_mesh_vertices()
+typedef struct { uint16_t x, y, z; } qvec3_t;
+
 //////////////////////
 // 2D Vector Functions
 //////////////////////
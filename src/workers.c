@@ -0,0 +1,144 @@
+#include "workers.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+// A fork-join pool. workers_run() posts a job, and the pool threads plus
+// the calling thread take task numbers from a shared counter until they
+// run out, so a slow task doesn't hold up the others' share. The caller
+// returns once every thread is done with the job.
+static struct {
+    int num_threads;  // pool threads plus the thread calling workers_run()
+    SDL_Thread* threads[WORKERS_MAX];
+    SDL_mutex* lock;
+    SDL_cond* job_posted;
+    SDL_cond* job_done;
+    bool is_stopping;
+
+    // The current job
+    int generation;  // bumped for every job
+    worker_task_t task;
+    void* data;
+    int num_tasks;
+    SDL_atomic_t next_task;
+    int num_busy;  // pool threads still working on the job
+} workers = {.num_threads = 1};
+
+static void run_tasks(worker_task_t task, void* data, int num_tasks) {
+    for (;;) {
+        int index = SDL_AtomicAdd(&workers.next_task, 1);
+        if (index >= num_tasks) {
+            break;
+        }
+        task(index, data);
+    }
+}
+
+static int worker_thread(void* unused) {
+    (void)unused;
+    // Threads are created before the first job, with the generation at 0
+    int generation = 0;
+
+    SDL_LockMutex(workers.lock);
+    for (;;) {
+        while (!workers.is_stopping && workers.generation == generation) {
+            SDL_CondWait(workers.job_posted, workers.lock);
+        }
+        if (workers.is_stopping) {
+            break;
+        }
+        generation = workers.generation;
+        worker_task_t task = workers.task;
+        void* data = workers.data;
+        int num_tasks = workers.num_tasks;
+        SDL_UnlockMutex(workers.lock);
+
+        run_tasks(task, data, num_tasks);
+
+        SDL_LockMutex(workers.lock);
+        if (--workers.num_busy == 0) {
+            SDL_CondSignal(workers.job_done);
+        }
+    }
+    SDL_UnlockMutex(workers.lock);
+
+    return 0;
+}
+
+/**
+ * Start the pool with num_threads threads in all, counting the caller.
+ * With 1 (or when threads can't be created) jobs run on the caller alone.
+ */
+void workers_start(int num_threads) {
+    if (num_threads > WORKERS_MAX) num_threads = WORKERS_MAX;
+    workers.num_threads = 1;
+    if (num_threads <= 1) {
+        return;
+    }
+
+    workers.lock = SDL_CreateMutex();
+    workers.job_posted = SDL_CreateCond();
+    workers.job_done = SDL_CreateCond();
+    workers.is_stopping = false;
+    workers.generation = 0;
+
+    for (int i = 1; i < num_threads; i++) {
+        SDL_Thread* thread = SDL_CreateThread(worker_thread, "worker", NULL);
+        if (thread == NULL) {
+            printf("cannot start worker thread: %s\n", SDL_GetError());
+            break;
+        }
+        workers.threads[workers.num_threads++] = thread;
+    }
+}
+
+int workers_count(void) { return workers.num_threads; }
+
+/**
+ * Run task(0, data) through task(num_tasks - 1, data) across the pool and
+ * wait for all of them.
+ */
+void workers_run(worker_task_t task, void* data, int num_tasks) {
+    if (workers.num_threads == 1 || num_tasks <= 1) {
+        for (int i = 0; i < num_tasks; i++) {
+            task(i, data);
+        }
+        return;
+    }
+
+    SDL_LockMutex(workers.lock);
+    workers.task = task;
+    workers.data = data;
+    workers.num_tasks = num_tasks;
+    SDL_AtomicSet(&workers.next_task, 0);
+    workers.num_busy = workers.num_threads - 1;
+    workers.generation++;
+    SDL_CondBroadcast(workers.job_posted);
+    SDL_UnlockMutex(workers.lock);
+
+    run_tasks(task, data, num_tasks);
+
+    SDL_LockMutex(workers.lock);
+    while (workers.num_busy > 0) {
+        SDL_CondWait(workers.job_done, workers.lock);
+    }
+    SDL_UnlockMutex(workers.lock);
+}
+
+void workers_stop(void) {
+    if (workers.num_threads == 1) {
+        return;
+    }
+
+    SDL_LockMutex(workers.lock);
+    workers.is_stopping = true;
+    SDL_CondBroadcast(workers.job_posted);
+    SDL_UnlockMutex(workers.lock);
+
+    for (int i = 1; i < workers.num_threads; i++) {
+        SDL_WaitThread(workers.threads[i], NULL);
+    }
+    SDL_DestroyCond(workers.job_done);
+    SDL_DestroyCond(workers.job_posted);
+    SDL_DestroyMutex(workers.lock);
+    workers.num_threads = 1;
+}
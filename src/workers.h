@@ -0,0 +1,17 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdbool.h>
+
+#define WORKERS_MAX 64
+
+// One piece of a job. Tasks of the same job run in any order, on any
+// thread, so each should write only to its own part of the output.
+typedef void (*worker_task_t)(int task, void* data);
+
+void workers_start(int num_threads);
+int workers_count(void);
+void workers_run(worker_task_t task, void* data, int num_tasks);
+void workers_stop(void);
+
+#endif
@@ -0,0 +1,183 @@
+// A small reader for the renderer's shared memory frames (--shm). It maps
+// the ring, reads each new frame in place and prints its sequence number
+// and how long ago it was finished. With a PPM path it also saves the
+// newest frame when it exits.
+//
+//     ./renderer --shm /3drenderer &
+//     ./frame_reader /3drenderer latest.ppm
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/shm_output.h"
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = ms * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * Save the ARGB pixels as a binary PPM file, dropping alpha.
+ */
+static void save_ppm(const char* path, const uint32_t* pixels, int width,
+                     int height) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height; i++) {
+        uint8_t rgb[3] = {(pixels[i] >> 16) & 0xFF, (pixels[i] >> 8) & 0xFF,
+                          pixels[i] & 0xFF};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+}
+
+/**
+ * Check that the header describes a ring that fits in the map_size bytes
+ * mapped, so a truncated or stale object can't make us read past the end.
+ */
+static bool is_ring_valid(const shm_ring_header_t* ring, uint64_t map_size) {
+    uint64_t pixels_size = (uint64_t)ring->width * ring->height * 4;
+    return ring->num_frames >= 1 &&
+           ring->num_frames <= SHM_OUTPUT_MAX_FRAMES &&
+           ring->frames_offset >= sizeof(shm_ring_header_t) &&
+           ring->frame_stride >= sizeof(shm_frame_header_t) + pixels_size &&
+           ring->frames_offset + (uint64_t)ring->num_frames *
+                                     ring->frame_stride <= map_size;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        printf("usage: %s NAME [OUT.ppm]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = shm_open(argv[1], O_RDONLY, 0);
+    if (fd == -1) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        perror(argv[1]);
+        close(fd);
+        return 1;
+    }
+    if ((uint64_t)info.st_size < sizeof(shm_ring_header_t)) {
+        printf("%s is too small to be a renderer frame ring\n", argv[1]);
+        close(fd);
+        return 1;
+    }
+    uint8_t* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    shm_ring_header_t* ring = (shm_ring_header_t*)map;
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_OUTPUT_MAGIC ||
+        ring->version != SHM_OUTPUT_VERSION) {
+        printf("%s is not a renderer frame ring\n", argv[1]);
+        munmap(map, info.st_size);
+        return 1;
+    }
+    // The renderer never changes the layout once the magic is set. Copy it,
+    // so the check below holds for the whole run.
+    shm_ring_header_t layout = *ring;
+    if (!is_ring_valid(&layout, info.st_size)) {
+        printf("%s is truncated or its header is corrupt\n", argv[1]);
+        munmap(map, info.st_size);
+        return 1;
+    }
+    printf("%ux%u, %u frames\n", layout.width, layout.height,
+           layout.num_frames);
+
+    // The newest whole frame, and a buffer to copy the next one into. Frame
+    // sizes come from the checked header, not each frame's size field.
+    size_t frame_size = (size_t)layout.width * layout.height * 4;
+    uint32_t* pixels = malloc(frame_size);
+    uint32_t* scratch = malloc(frame_size);
+    uint64_t last_sequence = 0;
+    uint64_t num_read = 0;
+    uint64_t num_missed = 0;
+
+    while (!__atomic_load_n(&ring->is_closed, __ATOMIC_ACQUIRE)) {
+        uint64_t sequence =
+            __atomic_load_n(&ring->latest_sequence, __ATOMIC_ACQUIRE);
+        if (sequence == last_sequence) {
+            sleep_ms(1);
+            continue;
+        }
+
+        uint32_t slot = (sequence - 1) % layout.num_frames;
+        shm_frame_header_t* header =
+            (shm_frame_header_t*)(map + layout.frames_offset +
+                                  (size_t)slot * layout.frame_stride);
+        const uint32_t* frame = (const uint32_t*)(header + 1);
+
+        if (__atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE) != sequence) {
+            continue;  // already being redrawn, go look for a newer one
+        }
+        uint64_t latency_ns = monotonic_ns() - header->timestamp_ns;
+
+        // Use the frame in place. Here that's a cheap checksum; only the
+        // PPM path keeps a copy, for saving at the end.
+        uint32_t checksum = 0;
+        for (size_t i = 0; i < frame_size / 4; i++) {
+            checksum = checksum * 31 + frame[i];
+        }
+        if (argc == 3) {
+            memcpy(scratch, frame, frame_size);
+        }
+
+        // The renderer zeroes the sequence before it draws into the slot
+        // again, so an unchanged sequence means the frame was whole
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != sequence) {
+            printf("frame %llu was overwritten while reading\n",
+                   (unsigned long long)sequence);
+            continue;
+        }
+
+        if (argc == 3) {
+            uint32_t* whole = scratch;
+            scratch = pixels;
+            pixels = whole;
+        }
+        if (last_sequence != 0) {
+            num_missed += sequence - last_sequence - 1;
+        }
+        last_sequence = sequence;
+        num_read++;
+        printf("frame %llu  %.2f ms old  checksum %08x\n",
+               (unsigned long long)sequence, latency_ns / 1e6, checksum);
+    }
+
+    printf("read %llu frames, missed %llu\n", (unsigned long long)num_read,
+           (unsigned long long)num_missed);
+    if (argc == 3 && num_read > 0) {
+        save_ppm(argv[2], pixels, layout.width, layout.height);
+    }
+
+    free(pixels);
+    free(scratch);
+    munmap(map, info.st_size);
+    return 0;
+}